@@ -1,3 +1,24 @@
 """energat package."""
+
 __version__ = "1.0.6"
-__all__ = ["basepower", "common", "target", "tracer"]
+__all__ = [
+    "basepower",
+    "common",
+    "kernel",
+    "perf",
+    "procfs",
+    "query",
+    "ring",
+    "rollup",
+    "scheduler",
+    "segments",
+    "sinks",
+    "sketch",
+    "snapshot",
+    "target",
+    "tasktrace",
+    "traceio",
+    "tracer",
+    "tsdb",
+    "writer",
+]
@@ -37,8 +37,115 @@ flags.DEFINE_float(
     "rapl_period", 0.01, "Sampling period in seconds for RAPL power meters"
 )
 flags.DEFINE_float("interval", 1, "Interval in seconds between two power estimation")
+flags.DEFINE_float(
+    "mem_period", 0.1, "Period in seconds for sampling private memory of each target"
+)
+flags.DEFINE_float(
+    "max_skew",
+    0.005,
+    "Maximum skew in seconds between the delta windows of the inputs and the energy",
+)
+flags.DEFINE_enum(
+    "skew_policy",
+    "correct",
+    ["correct", "reject"],
+    "Handling of intervals whose inputs are skewed by more than `max_skew`",
+)
 flags.DEFINE_float("gamma", 0.3, "Non-linear scaling factor for CPU power")
 flags.DEFINE_float("delta", 0.2, "Non-linear scaling factor for DRAM power")
+flags.DEFINE_enum(
+    "cpu_credit",
+    "cputime",
+    ["cputime", "cgroup", "cycles"],
+    "Activity weight for crediting CPU package energy",
+)
+flags.DEFINE_string(
+    "cgroup", None, "Cgroup (v2) of the target, used with `cpu_credit=cgroup`"
+)
+flags.DEFINE_enum(
+    "dram_credit",
+    "rss",
+    ["rss", "traffic"],
+    "Activity weight for crediting DRAM energy (private memory or memory traffic)",
+)
+flags.DEFINE_bool(
+    "kernel_credit",
+    False,
+    "Credit irq/softirq time and kernel-thread runtime to the targets by I/O share",
+)
+flags.DEFINE_bool(
+    "task_output",
+    False,
+    "Write per-task and per-process energy breakdowns next to the traces",
+)
+flags.DEFINE_enum(
+    "task_format",
+    "npz",
+    ["npz", "stream"],
+    "Format of the per-task breakdowns (npz chunks, or a zstd/zlib frame stream)",
+)
+flags.DEFINE_enum(
+    "trace_format",
+    "csv",
+    ["csv", "binary"],
+    "Format of the traces (csv/binary, see `energat.traceio`)",
+)
+flags.DEFINE_list(
+    "trace_sinks",
+    [],
+    "Sinks of the traces besides the trace file "
+    "(csv, binary, ndjson, stdout, tcp:HOST:PORT, unix:PATH)",
+)
+flags.DEFINE_float(
+    "segment_sec",
+    0,
+    "Seconds of traces per segment file (0 for one file, see `energat.segments`)",
+)
+flags.DEFINE_float(
+    "fsync_sec",
+    1.0,
+    "Seconds between fsyncs of binary traces (0 to not fsync by time)",
+)
+flags.DEFINE_integer(
+    "fsync_bytes",
+    0,
+    "Bytes between fsyncs of binary traces (0 to not fsync by size)",
+)
+flags.DEFINE_enum(
+    "writer_policy",
+    "spill",
+    ["block", "drop_oldest", "spill"],
+    "What to do with traces when the writer falls behind (block/drop_oldest/spill)",
+)
+flags.DEFINE_integer(
+    "writer_queue", 4, "Batches of traces waiting to be written before `writer_policy`"
+)
+flags.DEFINE_float(
+    "tsdb_retention",
+    0,
+    "Seconds of raw counters and attributions kept compressed in memory (0 to disable)",
+)
+flags.DEFINE_bool(
+    "rollups",
+    False,
+    "Write 1s/1min/1h energy and power aggregates per socket, domain and tenant",
+)
+flags.DEFINE_integer(
+    "live_rows",
+    0,
+    "Latest traces shared with `EnergyTracer.live_traces()` (0 to disable)",
+)
+flags.DEFINE_integer(
+    "max_tasks", 32768, "Maximum number of tasks sampled through shared memory"
+)
+flags.DEFINE_bool(
+    "static_residence",
+    True,
+    "Place tasks confined to one socket (by affinity or cpuset) without sampling",
+)
+flags.DEFINE_integer(
+    "top_k", 0, "Number of heaviest tasks reported per socket (0 to disable)"
+)
 flags.DEFINE_float(
     "logging", 2, "Logging interval in seconds (with `loglvl=debug` only)"
 )
@@ -65,25 +172,43 @@ def read_cputime_sec(pid: float):
 
     (We can't use `psutil`, since it returns the aggregated values of a thread.)
     """
+    return read_cputime_and_cpu(pid)[0]
+
+
+def read_cputime_and_cpu(pid: float) -> Tuple[float, int]:
+    """Get cpu time and the CPU last run on for a process/thread.
+
+    :return: {Tuple[float, int]} (cputime in seconds, CPU id or -1 if gone)
+    """
     if not target_exists(pid):
         logger.warn(f"{pid=} has gone")
         # ! Prevent div by 0
-        return 0
-    num_clock_ticks = 0
+        return 0, -1
     # * We have to read the inner-most stat file to always get
     # * per-thread information (see: https://stackoverflow.com/a/59126812).
     # * (if it's a process, then it's its own runtime.)
     statf = f"/proc/{pid}/task/{pid}/stat"
 
-    with open(statf, "r") as f:
-        stat = (f.read()[:-1]).split()
-        # * The 14th and 15th values are user and kernel times respectively.
-        # * (https://man7.org/linux/man-pages/man5/proc.5.html)
-        # print(f"{int(stat[14-1])=} {int(stat[15-1])=}")
-        num_clock_ticks = int(stat[14 - 1]) + int(stat[15 - 1])
+    # * (Imported here, as `energat.procfs` depends on this module.)
+    from energat.procfs import parse_task_stat
+
+    try:
+        with open(statf, "r") as f:
+            stat = f.read()
+    except (FileNotFoundError, ProcessLookupError):
+        # * Exited since the check.
+        logger.warning(f"{pid=} has gone")
+        return 0, -1
+    # * Fields from the 3rd on, as the command name may contain spaces.
+    stat = parse_task_stat(stat)
+    # * The 14th and 15th values are user and kernel times respectively,
+    # * and the 39th is the CPU last run on.
+    # * (https://man7.org/linux/man-pages/man5/proc.5.html)
+    num_clock_ticks = int(stat[14 - 3]) + int(stat[15 - 3])
+    cpu = int(stat[39 - 3])
     # * Convert clock ticks to seconds.
     cputime_sec = num_clock_ticks / CLK_TCK_PER_SEC
-    return cputime_sec
+    return cputime_sec, cpu
 
 
 def target_exists(pid: int):
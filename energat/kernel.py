@@ -0,0 +1,630 @@
+from typing import *
+
+import numpy as np
+import numpy.typing as npt
+
+from energat.sketch import SpaceSaving, top_k
+
+"""Multiplier for Fibonacci hashing (2^64 / golden ratio)."""
+FIB_HASH_MULT = np.uint64(0x9E3779B97F4A7C15)
+
+
+class SlotMap(object):
+    """Flat open-addressing map from TIDs to dense slot ids (linear probing).
+
+    Keys and values live in two flat arrays, so a batch of TIDs is looked up
+    with a handful of vectorized probing passes.
+    """
+
+    EMPTY = -1
+    TOMBSTONE = -2
+    MAX_LOAD = 0.7
+
+    def __init__(self, capacity: int = 1024):
+        self.bits = max(4, (capacity - 1).bit_length())
+        self.keys = np.full(1 << self.bits, self.EMPTY, dtype=np.int64)
+        self.values = np.full(1 << self.bits, -1, dtype=np.int64)
+        self.size = 0  # * Live keys.
+        self.used = 0  # * Live keys and tombstones.
+
+    def __len__(self):
+        return self.size
+
+    def _hash(self, keys: np.ndarray) -> np.ndarray:
+        with np.errstate(over="ignore"):
+            hashed = keys.astype(np.uint64) * FIB_HASH_MULT
+        return (hashed >> np.uint64(64 - self.bits)).astype(np.int64)
+
+    def lookup(self, tids: npt.ArrayLike) -> np.ndarray:
+        """Looks up a batch of TIDs.
+
+        :return: {np.ndarray} Slot of each TID (-1 if absent).
+        """
+        tids = np.asarray(tids, dtype=np.int64).ravel()
+        slots = np.full(tids.size, -1, dtype=np.int64)
+        mask = self.keys.size - 1
+        pending = np.arange(tids.size)
+        pos = self._hash(tids)
+        while pending.size:
+            keys = self.keys[pos]
+            hit = keys == tids[pending]
+            slots[pending[hit]] = self.values[pos[hit]]
+            # * Keep probing past tombstones and other keys until an empty bucket.
+            probing = ~hit & (keys != self.EMPTY)
+            pending, pos = pending[probing], (pos[probing] + 1) & mask
+        return slots
+
+    def get(self, tid: int) -> int:
+        return int(self.lookup([tid])[0])
+
+    def _find(self, tid: int) -> Tuple[int, int]:
+        """:return: (bucket of `tid` or -1, first reusable bucket on its chain)"""
+        mask = self.keys.size - 1
+        pos = int(self._hash(np.array([tid]))[0])
+        reusable = -1
+        while True:
+            key = self.keys[pos]
+            if key == tid:
+                return pos, reusable
+            if key == self.EMPTY:
+                return -1, pos if reusable < 0 else reusable
+            if key == self.TOMBSTONE and reusable < 0:
+                reusable = pos
+            pos = (pos + 1) & mask
+
+    def insert(self, tid: int, slot: int):
+        found, free = self._find(tid)
+        if found >= 0:
+            self.values[found] = slot
+            return
+        if self.keys[free] == self.EMPTY:
+            self.used += 1
+        self.keys[free], self.values[free] = tid, slot
+        self.size += 1
+        if self.used > self.MAX_LOAD * self.keys.size:
+            self._rehash(
+                self.bits + 1 if self.size > self.keys.size // 4 else self.bits
+            )
+
+    def remove(self, tid: int) -> int:
+        """:return: {int} Slot of the removed TID (-1 if absent)."""
+        found, _ = self._find(tid)
+        if found < 0:
+            return -1
+        slot = int(self.values[found])
+        self.keys[found] = self.TOMBSTONE
+        self.size -= 1
+        return slot
+
+    def clear(self):
+        self.keys[:] = self.EMPTY
+        self.size = self.used = 0
+
+    def _rehash(self, bits: int):
+        live = self.keys >= 0
+        keys, values = self.keys[live], self.values[live]
+        self.bits = bits
+        self.keys = np.full(1 << bits, self.EMPTY, dtype=np.int64)
+        self.values = np.full(1 << bits, -1, dtype=np.int64)
+        self.size = self.used = 0
+        for tid, slot in zip(keys.tolist(), values.tolist()):
+            self.insert(tid, slot)
+
+
+class AttributionKernel(object):
+    """Per-task attribution state as structure-of-arrays indexed by dense slots.
+
+    Every column below is one contiguous array; row `i` belongs to the task in
+    slot `i`. CPU and DRAM credits of all tasks are computed with a few
+    vectorized passes over the live slots.
+    """
+
+    def __init__(self, num_sockets: int, capacity: int = 256, max_capacity: int = None):
+        self.num_sockets = num_sockets
+        self.slot_map = SlotMap(2 * capacity)
+        self.capacity = 0
+        # * Slots are never handed out beyond `max_capacity` (unbounded if None).
+        self.max_capacity = max_capacity
+        # * Generation of the next task placed in a slot.
+        self.next_gen = 1
+        # * Slots in [0, high_water) have been handed out at least once.
+        self.high_water = 0
+        self.free_slots: List[int] = []
+        # * TGID -> slot that samples memory for the whole thread group.
+        self.mem_owners: Dict[int, int] = {}
+        # * Temporaries of the attribution passes, released every interval.
+        self.arena = ScratchArena()
+        # * Per-socket sketches of the heaviest tasks since the start.
+        self.top_tasks: List[SpaceSaving] = []
+        # * Slots whose residence and memory are sampled (see `plan_sampling()`).
+        self.residence_slots = np.empty(0, dtype=np.int64)
+        self.memory_slots = np.empty(0, dtype=np.int64)
+        self._grow(capacity)
+
+    def __len__(self):
+        return len(self.slot_map)
+
+    def _grow(self, capacity: int):
+        def extend(column, fill, dtype, width=None):
+            shape = (capacity,) if width is None else (capacity, width)
+            grown = np.full(shape, fill, dtype=dtype)
+            if column is not None:
+                grown[: self.capacity] = column
+            return grown
+
+        S = self.num_sockets
+        get = lambda name: getattr(self, name, None)
+        self.tids = extend(get("tids"), -1, np.int64)
+        self.gens = extend(get("gens"), 0, np.int64)
+        self.tgids = extend(get("tgids"), -1, np.int64)
+        self.alive = extend(get("alive"), False, bool)
+        # * Tasks that ran in the last interval (or have just been added).
+        self.active = extend(get("active"), False, bool)
+        self.is_tracer = extend(get("is_tracer"), False, bool)
+        self.mem_owner = extend(get("mem_owner"), False, bool)
+        # * Socket of tasks that can only run on one socket (-1 otherwise).
+        self.pinned = extend(get("pinned"), -1, np.int64)
+        self.last_cputime = extend(get("last_cputime"), 0.0, np.float64)
+        self.cputime_delta = extend(get("cputime_delta"), 0.0, np.float64)
+        # * [slot x socket] residence counters.
+        self.residence = extend(get("residence"), 0, np.int64, S)
+        # * [slot x socket] sums of private memory (MiB) over samples.
+        self.mem_mib_acc = extend(get("mem_mib_acc"), 0.0, np.float64, S)
+        # * [slot x socket] sums of private/server memory ratios over samples.
+        self.mem_ratio_acc = extend(get("mem_ratio_acc"), 0.0, np.float64, S)
+        # * Number of memory samples per slot.
+        self.mem_samples = extend(get("mem_samples"), 0, np.int64)
+        # * Samples of the last interval in which each slot has been sampled.
+        self.last_residence = extend(get("last_residence"), 0, np.int64, S)
+        self.last_mem_mib = extend(get("last_mem_mib"), 0.0, np.float64, S)
+        self.last_mem_ratio = extend(get("last_mem_ratio"), 0.0, np.float64, S)
+        self.last_mem_samples = extend(get("last_mem_samples"), 0, np.int64)
+        self.capacity = capacity
+
+    def add(self, tid: int, tgid: int, cputime: float, is_tracer=False) -> int:
+        """Registers a task (or refreshes it if present).
+
+        :return: {int} Slot of the task (-1 if all `max_capacity` slots are taken).
+        """
+        slot = self.slot_map.get(tid)
+        if slot < 0:
+            if self.free_slots:
+                slot = self.free_slots.pop()
+            elif self.high_water == self.max_capacity:
+                return -1
+            else:
+                if self.high_water == self.capacity:
+                    capacity = 2 * self.capacity
+                    if self.max_capacity is not None:
+                        capacity = min(capacity, self.max_capacity)
+                    self._grow(capacity)
+                slot = self.high_water
+                self.high_water += 1
+            self.slot_map.insert(tid, slot)
+            self._reset_slot(slot)
+            self.active[slot] = True
+            self.gens[slot] = self.next_gen
+            self.next_gen += 1
+
+        self.tids[slot], self.tgids[slot] = tid, tgid
+        self.alive[slot] = True
+        self.is_tracer[slot] = is_tracer
+        self.last_cputime[slot] = cputime
+        if tgid not in self.mem_owners:
+            self.mem_owners[tgid] = slot
+            self.mem_owner[slot] = True
+        return slot
+
+    def remove(self, tid: int):
+        slot = self.slot_map.remove(tid)
+        if slot < 0:
+            return
+        tgid = int(self.tgids[slot])
+        self.alive[slot] = False
+        self.active[slot] = False
+        self.tids[slot] = -1
+        self.free_slots.append(slot)
+        if self.mem_owner[slot]:
+            self.mem_owner[slot] = False
+            del self.mem_owners[tgid]
+            # * Hand memory sampling over to another thread of the same group.
+            siblings = np.flatnonzero(
+                self.alive[: self.high_water] & (self.tgids[: self.high_water] == tgid)
+            )
+            if siblings.size:
+                self.mem_owners[tgid] = int(siblings[0])
+                self.mem_owner[siblings[0]] = True
+
+    def clear(self):
+        self.slot_map.clear()
+        self.mem_owners = {}
+        self.free_slots = []
+        self.high_water = 0
+        self.alive[:] = False
+        self.active[:] = False
+        self.mem_owner[:] = False
+        self.pinned[:] = -1
+        self.tids[:] = -1
+        self.reset_samples()
+        self.plan_sampling()
+
+    def _reset_slot(self, slot: int):
+        self.mem_owner[slot] = False
+        self.pinned[slot] = -1
+        self.cputime_delta[slot] = 0.0
+        self.residence[slot] = 0
+        self.mem_mib_acc[slot] = 0.0
+        self.mem_ratio_acc[slot] = 0.0
+        self.mem_samples[slot] = 0
+        self.last_residence[slot] = 0
+        self.last_mem_mib[slot] = 0.0
+        self.last_mem_ratio[slot] = 0.0
+        self.last_mem_samples[slot] = 0
+
+    def reset_samples(self):
+        """Clears per-interval samples of all slots in place (keeping cputimes)
+        and releases the scratch memory of the interval."""
+        self.arena.reset()
+        hw = self.high_water
+        self.cputime_delta[:hw] = 0.0
+        self.residence[:hw] = 0
+        self.mem_mib_acc[:hw] = 0.0
+        self.mem_ratio_acc[:hw] = 0.0
+        self.mem_samples[:hw] = 0
+
+    def live_slots(self) -> np.ndarray:
+        return np.flatnonzero(self.alive[: self.high_water])
+
+    def active_slots(self) -> np.ndarray:
+        return np.flatnonzero(self.active[: self.high_water])
+
+    def owner_slots(self) -> np.ndarray:
+        """Slots sampling memory on behalf of their thread groups."""
+        return np.flatnonzero(self.mem_owner[: self.high_water])
+
+    def slots_of(self, tids: Iterable[int]) -> np.ndarray:
+        return self.slot_map.lookup(np.fromiter(tids, dtype=np.int64))
+
+    def update_cputime(self, slots: np.ndarray, cputimes: np.ndarray):
+        """Sets the cputime deltas of `slots` from their cumulative cputimes, and
+        marks the slots that ran as active."""
+        cputimes = np.asarray(cputimes, dtype=np.float64)
+        self.cputime_delta[slots] = cputimes - self.last_cputime[slots]
+        self.last_cputime[slots] = cputimes
+        assert (self.cputime_delta[slots] >= 0).all(), "Negative cputime delta"
+        self.active[slots] = self.cputime_delta[slots] > 0
+
+    def pin(self, slot: int, socket: int):
+        """Confines a task to one socket (or lets it migrate if `socket` is -1).
+
+        Pinned tasks reside on their socket with probability 1, so they are never
+        sampled.
+        """
+        self.pinned[slot] = socket
+
+    def unpin_strays(self, slots: np.ndarray, sockets: np.ndarray) -> np.ndarray:
+        """Lets pinned tasks seen on another socket migrate again.
+
+        :param sockets: Sockets the tasks in `slots` have last run on.
+        :return: {np.ndarray} Slots that have been unpinned.
+        """
+        pinned = self.pinned[slots]
+        strays = slots[(pinned >= 0) & (sockets >= 0) & (pinned != sockets)]
+        self.pinned[strays] = -1
+        return strays
+
+    def scale_cputime(self, factor: float, slots: np.ndarray):
+        """Rescales the cputime deltas of `slots` (e.g., to another window)."""
+        self.cputime_delta[slots] *= factor
+
+    def generations(self) -> Tuple[np.ndarray, np.ndarray]:
+        """:return: {Tuple} (live slots, generation of their tasks)"""
+        slots = self.live_slots()
+        return slots, self.gens[slots]
+
+    def same_tasks(self, slots: np.ndarray, gens: np.ndarray) -> np.ndarray:
+        """:return: {np.ndarray} `slots` still holding the tasks of `gens`."""
+        return slots[self.alive[slots] & (self.gens[slots] == gens)]
+
+    def plan_sampling(self):
+        """Chooses the slots sampled until the next plan.
+
+        Only active tasks that may migrate are sampled, and only the memory of
+        thread groups with an active thread. Idle tasks keep the samples of their
+        last active interval.
+        """
+        hw = self.high_water
+        active = self.active[:hw]
+        group_active = np.isin(self.tgids[:hw], self.tgids[:hw][active])
+        self.residence_slots = np.flatnonzero(active & (self.pinned[:hw] < 0))
+        self.memory_slots = np.flatnonzero(self.mem_owner[:hw] & group_active)
+
+    def sampled_slots(self) -> Tuple[np.ndarray, np.ndarray]:
+        """:return: {Tuple} (slots whose residence is sampled, slots whose memory
+        is sampled) of the plan, without those removed since."""
+        residence, memory = self.residence_slots, self.memory_slots
+        return residence[self.alive[residence]], memory[self.mem_owner[memory]]
+
+    def record_residence(self, slots: np.ndarray, sockets: np.ndarray):
+        """Counts one residence sample of each of `slots` on its socket."""
+        np.add.at(self.residence, (slots, sockets), 1)
+
+    def record_memory(
+        self, slots: np.ndarray, private_mib: npt.ArrayLike, server_mib: npt.ArrayLike
+    ):
+        """Adds one memory sample of each of `slots`.
+
+        :param private_mib: [len(slots) x num_sockets] private memory.
+        :param server_mib: [num_sockets] used memory of the server.
+        """
+        private_mib = np.asarray(private_mib, dtype=np.float64).reshape(
+            -1, self.num_sockets
+        )
+        server_mib = np.asarray(server_mib, dtype=np.float64)
+        self.mem_mib_acc[slots] += private_mib
+        self.mem_ratio_acc[slots] += np.divide(
+            private_mib,
+            server_mib,
+            out=np.zeros_like(private_mib),
+            where=server_mib > 0,
+        )
+        self.mem_samples[slots] += 1
+
+    def settle_samples(self):
+        """Completes the samples of the interval before they are used."""
+        """Placing pinned tasks on their sockets."""
+        pinned = np.flatnonzero(self.pinned[: self.high_water] >= 0)
+        self.residence[pinned] = 0
+        self.residence[pinned, self.pinned[pinned]] = 1
+        self.carry_samples()
+
+    def carry_samples(self):
+        """Substitutes the samples of the last sampled interval for slots without
+        samples in this one (idle tasks or owners not visited yet)."""
+        hw = self.high_water
+        sampled = self.residence[:hw].any(axis=1)[:, None]
+        np.copyto(self.last_residence[:hw], self.residence[:hw], where=sampled)
+        np.copyto(self.residence[:hw], self.last_residence[:hw], where=~sampled)
+
+        sampled = self.mem_samples[:hw] > 0
+        np.copyto(self.last_mem_samples[:hw], self.mem_samples[:hw], where=sampled)
+        np.copyto(self.mem_samples[:hw], self.last_mem_samples[:hw], where=~sampled)
+        sampled = sampled[:, None]
+        for column, last in (
+            (self.mem_mib_acc, self.last_mem_mib),
+            (self.mem_ratio_acc, self.last_mem_ratio),
+        ):
+            np.copyto(last[:hw], column[:hw], where=sampled)
+            np.copyto(column[:hw], last[:hw], where=~sampled)
+
+    def residence_probs(self, slots: np.ndarray) -> np.ndarray:
+        """:return: {np.ndarray} [len(slots) x num_sockets] residence probabilities
+        (uniform for tasks that have never been sampled)."""
+        if self.num_sockets < 2:
+            return np.ones((slots.size, 1))
+        counts = self.residence[slots]
+        totals = counts.sum(axis=1, keepdims=True)
+        return np.divide(
+            counts,
+            totals,
+            out=np.full(counts.shape, 1.0 / self.num_sockets),
+            where=totals > 0,
+        )
+
+    def gather(self, column: np.ndarray, slots: np.ndarray) -> np.ndarray:
+        """Copies rows `slots` of a column into scratch memory."""
+        out = self.arena.take((slots.size,) + column.shape[1:], column.dtype)
+        return np.take(column, slots, axis=0, out=out)
+
+    def group_weights(self, slots: np.ndarray, weights: np.ndarray) -> np.ndarray:
+        """Splits per-task `weights` into rows of (targets, tracer).
+
+        :return: {np.ndarray} [2 x len(slots)] (in scratch memory)
+        """
+        tracer = self.gather(self.is_tracer, slots)
+        grouped = self.arena.take((2, slots.size), fill=0.0)
+        np.copyto(grouped[0], weights, where=~tracer)
+        np.copyto(grouped[1], weights, where=tracer)
+        return grouped
+
+    def cputime_per_socket(self) -> Tuple[np.ndarray, np.ndarray]:
+        """Distributes cputime deltas over sockets by residence probabilities.
+
+        Since cputime_i * counts_i / total_i summed over tasks equals
+        (cputime / total) @ counts, the per-socket sums of both the targets and the
+        tracer are one division and one matrix product over the live slots.
+
+        Only active slots hold cputime, so idle tasks are skipped.
+
+        :return: ([num_sockets] cputime of targets, [num_sockets] cputime of the tracer)
+        """
+        slots = self.active_slots()
+        cputime = self.gather(self.cputime_delta, slots)
+        if self.num_sockets < 2:
+            grouped = self.group_weights(slots, cputime).sum(axis=1, keepdims=True)
+            return grouped[0], grouped[1]
+
+        counts = self.gather(self.residence, slots)
+        totals = counts.sum(axis=1, out=self.arena.take(slots.size, np.int64))
+        sampled = np.greater(totals, 0, out=self.arena.take(slots.size, bool))
+        weights = np.divide(
+            cputime, totals, out=self.arena.take(slots.size, fill=0.0), where=sampled
+        )
+        socket_cputime = self.group_weights(slots, weights) @ counts
+        # * Tasks that have never been sampled are spread uniformly.
+        np.copyto(cputime, 0.0, where=sampled)
+        unsampled = self.group_weights(slots, cputime)
+        socket_cputime += unsampled.sum(axis=1, keepdims=True) / self.num_sockets
+        return socket_cputime[0], socket_cputime[1]
+
+    def memory_per_socket(self) -> Tuple[np.ndarray, np.ndarray, np.ndarray]:
+        """Averages memory samples of thread-group owners over the interval
+        (each over its own number of samples).
+
+        :return: ([num_sockets] mean private/server ratio of targets,
+            [num_sockets] mean private/server ratio of the tracer,
+            [num_sockets] mean private MiB of targets)
+        """
+        S = self.num_sockets
+        slots = self.owner_slots()
+        if slots.size == 0:
+            return np.zeros(S), np.zeros(S), np.zeros(S)
+        samples = self.gather(self.mem_samples, slots)
+        weights = np.divide(
+            1.0, samples, out=self.arena.take(slots.size, fill=0.0), where=samples > 0
+        )
+        grouped = self.group_weights(slots, weights)
+        ratios = grouped @ self.gather(self.mem_ratio_acc, slots)
+        mibs = grouped[0] @ self.gather(self.mem_mib_acc, slots)
+        return ratios[0], ratios[1], mibs
+
+    def task_energy(
+        self, cpu_energy: np.ndarray, dram_energy: np.ndarray
+    ) -> Tuple[np.ndarray, np.ndarray, np.ndarray]:
+        """Splits the energy ascribed to the targets over their live tasks.
+
+        CPU energy of each socket is split by residence-weighted cputime. DRAM
+        energy of each socket is split over thread groups by their mean
+        private/server memory ratio, and within a group by cputime (evenly if none
+        of its threads ran).
+
+        :param cpu_energy: [num_sockets] CPU energy ascribed to the targets.
+        :param dram_energy: [num_sockets] DRAM energy ascribed to the targets.
+        :return: ([n] slots, [n x num_sockets] CPU joules,
+            [n x num_sockets] DRAM joules)
+        """
+        S = self.num_sockets
+        hw = self.high_water
+        slots = np.flatnonzero(self.alive[:hw] & ~self.is_tracer[:hw])
+        cputime = self.cputime_delta[slots]
+
+        weights = cputime[:, None] * self.residence_probs(slots)
+        totals = weights.sum(axis=0)
+        cpu_j = np.divide(
+            weights * cpu_energy, totals, out=np.zeros(weights.shape), where=totals > 0
+        )
+
+        groups, inverse = np.unique(self.tgids[slots], return_inverse=True)
+        samples = self.mem_samples[slots]
+        sampled = (self.mem_owner[slots] & (samples > 0))[:, None]
+        ratios = np.divide(
+            self.mem_ratio_acc[slots],
+            samples[:, None],
+            out=np.zeros((slots.size, S)),
+            where=sampled,
+        )
+        group_ratios = np.zeros((groups.size, S))
+        np.add.at(group_ratios, inverse, ratios)
+        total_ratios = group_ratios.sum(axis=0)
+        group_dram = np.divide(
+            group_ratios * dram_energy,
+            total_ratios,
+            out=np.zeros(group_ratios.shape),
+            where=total_ratios > 0,
+        )
+        group_cputime = np.bincount(inverse, cputime, minlength=groups.size)[inverse]
+        group_size = np.bincount(inverse, minlength=groups.size)[inverse]
+        within = np.divide(
+            cputime,
+            group_cputime,
+            out=1.0 / np.maximum(group_size, 1),
+            where=group_cputime > 0,
+        )
+        dram_j = group_dram[inverse] * within[:, None]
+        return slots, cpu_j, dram_j
+
+    def rank_tasks(
+        self,
+        slots: np.ndarray,
+        joules: np.ndarray,
+        labels: np.ndarray,
+        k: int,
+        sketch_factor: int = 4,
+    ) -> Tuple[List[List[Tuple]], List[List[Tuple]]]:
+        """Ranks the heaviest tasks of each socket in the interval and since the
+        start (in bounded memory, with `sketch_factor * k` counters per socket).
+
+        :param joules: [len(slots) x num_sockets] energy of each task.
+        :param labels: [len(slots)] names of the tasks.
+        :return: (per socket [(tid, label, joules)] of the interval,
+            per socket [(tid, label, upper bound, error)] since the start)
+        """
+        if not self.top_tasks:
+            self.top_tasks = [
+                SpaceSaving(sketch_factor * k) for _ in range(self.num_sockets)
+            ]
+        tids = self.tids[slots]
+        interval, total = [], []
+        for socket, sketch in enumerate(self.top_tasks):
+            weights = joules[:, socket]
+            interval.append(
+                [(int(tids[i]), labels[i], weights[i]) for i in top_k(tids, weights, k)]
+            )
+            sketch.update(tids, weights, labels)
+            total.append(sketch.top(k))
+        return interval, total
+
+
+class ScratchArena(object):
+    """Bump allocator for per-interval temporaries.
+
+    Views handed out by `take()` share one preallocated block and are all released
+    at once by `reset()` at the end of an interval. If an interval needs more than
+    the block, the rest is served from the heap and the block grows on reset.
+    """
+
+    ALIGNMENT = 64
+
+    def __init__(self, nbytes: int = 1 << 16):
+        self.block = np.empty(nbytes, dtype=np.uint8)
+        self.offset = 0
+
+    def take(self, shape, dtype=np.float64, fill=None) -> np.ndarray:
+        dtype = np.dtype(dtype)
+        shape = (shape,) if isinstance(shape, int) else tuple(shape)
+        nbytes = int(np.prod(shape)) * dtype.itemsize
+        start = -(-self.offset // self.ALIGNMENT) * self.ALIGNMENT
+        self.offset = start + nbytes
+        if self.offset <= self.block.size:
+            array = self.block[start : self.offset].view(dtype).reshape(shape)
+        else:
+            array = np.empty(shape, dtype=dtype)
+        if fill is not None:
+            array.fill(fill)
+        return array
+
+    def reset(self):
+        if self.offset > self.block.size:
+            self.block = np.empty(2 * self.offset, dtype=np.uint8)
+        self.offset = 0
+
+
+def credit_fracs(
+    numer: npt.ArrayLike,
+    denom: npt.ArrayLike,
+    empty: float = 0.0,
+    out: np.ndarray = None,
+) -> np.ndarray:
+    """Computes min(1, numer / denom) elementwise, or `empty` where denom <= 0.
+
+    Each step runs as one in-place ufunc pass over `out`.
+    """
+    numer, denom = np.asarray(numer, dtype=np.float64), np.asarray(denom)
+    if out is None:
+        out = np.empty(numer.shape)
+    out.fill(empty)
+    np.divide(numer, denom, out=out, where=denom > 0)
+    np.minimum(out, 1.0, out=out)
+    return out
+
+
+def power_law_energy(
+    energy: npt.ArrayLike,
+    fracs: npt.ArrayLike,
+    exponent: float,
+    out: np.ndarray = None,
+) -> np.ndarray:
+    """Computes energy * fracs ** exponent elementwise (in place on `out`)."""
+    out = np.power(fracs, exponent, out=out)
+    np.multiply(out, energy, out=out)
+    return out
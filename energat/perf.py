@@ -0,0 +1,460 @@
+import ctypes
+import os
+import platform
+import resource
+import struct
+from typing import *
+
+import numpy as np
+
+from energat.common import *
+from energat.procfs import parse_cpu_list
+
+# * Constants from include/uapi/linux/perf_event.h.
+PERF_TYPE_HARDWARE = 0
+
+PERF_COUNT_HW_CPU_CYCLES = 0
+PERF_COUNT_HW_INSTRUCTIONS = 1
+PERF_COUNT_HW_CACHE_MISSES = 3
+PERF_COUNT_HW_REF_CPU_CYCLES = 9
+
+PERF_FORMAT_TOTAL_TIME_ENABLED = 1 << 0
+PERF_FORMAT_TOTAL_TIME_RUNNING = 1 << 1
+PERF_FORMAT_GROUP = 1 << 3
+
+PERF_FLAG_PID_CGROUP = 1 << 2
+PERF_FLAG_FD_CLOEXEC = 1 << 3
+
+# * Bits of the `perf_event_attr` flag word.
+ATTR_FLAG_INHERIT = 1 << 1
+ATTR_FLAG_EXCLUDE_HV = 1 << 6
+
+"""Syscall number of perf_event_open(2) per architecture."""
+NR_PERF_EVENT_OPEN: Dict[str, int] = {
+    "x86_64": 298,
+    "aarch64": 241,
+    "ppc64le": 319,
+}
+
+
+class PerfEventAttr(ctypes.Structure):
+    """`struct perf_event_attr` (PERF_ATTR_SIZE_VER8)."""
+
+    _fields_ = [
+        ("type", ctypes.c_uint32),
+        ("size", ctypes.c_uint32),
+        ("config", ctypes.c_uint64),
+        ("sample_period", ctypes.c_uint64),
+        ("sample_type", ctypes.c_uint64),
+        ("read_format", ctypes.c_uint64),
+        ("flags", ctypes.c_uint64),
+        ("wakeup_events", ctypes.c_uint32),
+        ("bp_type", ctypes.c_uint32),
+        ("config1", ctypes.c_uint64),
+        ("config2", ctypes.c_uint64),
+        ("branch_sample_type", ctypes.c_uint64),
+        ("sample_regs_user", ctypes.c_uint64),
+        ("sample_stack_user", ctypes.c_uint32),
+        ("clockid", ctypes.c_int32),
+        ("sample_regs_intr", ctypes.c_uint64),
+        ("aux_watermark", ctypes.c_uint32),
+        ("sample_max_stack", ctypes.c_uint16),
+        ("reserved_2", ctypes.c_uint16),
+        ("aux_sample_size", ctypes.c_uint32),
+        ("reserved_3", ctypes.c_uint32),
+        ("sig_data", ctypes.c_uint64),
+        ("config3", ctypes.c_uint64),
+    ]
+
+
+_libc = ctypes.CDLL(None, use_errno=True)
+_libc.syscall.restype = ctypes.c_long
+
+
+def perf_event_open(
+    attr: PerfEventAttr, pid: int, cpu: int, group_fd: int = -1, flags: int = 0
+) -> int:
+    """Thin wrapper around perf_event_open(2).
+
+    :raises OSError: If the kernel rejects the event.
+    :return: {int} File descriptor of the event.
+    """
+    nr = NR_PERF_EVENT_OPEN.get(platform.machine())
+    if nr is None:
+        raise OSError(f"perf_event_open unsupported on {platform.machine()}")
+
+    attr.size = ctypes.sizeof(PerfEventAttr)
+    fd = _libc.syscall(
+        nr,
+        ctypes.byref(attr),
+        ctypes.c_int(pid),
+        ctypes.c_int(cpu),
+        ctypes.c_int(group_fd),
+        ctypes.c_ulong(flags | PERF_FLAG_FD_CLOEXEC),
+    )
+    if fd < 0:
+        errno = ctypes.get_errno()
+        raise OSError(errno, f"perf_event_open: {os.strerror(errno)}")
+    return fd
+
+
+def make_attr(type_: int, config: int, read_format: int = 0, flags: int = 0):
+    attr = PerfEventAttr()
+    attr.type = type_
+    attr.config = config
+    attr.read_format = read_format
+    attr.flags = flags | ATTR_FLAG_EXCLUDE_HV
+    return attr
+
+
+def read_group(fd: int, num_events: int) -> np.ndarray:
+    """Reads a counter group and scales the values for multiplexing.
+
+    Layout: {nr, time_enabled, time_running, value[nr]}.
+
+    :return: {np.ndarray} [num_events x 1] scaled counts.
+    """
+    buf = os.read(fd, 8 * (3 + num_events))
+    nr, enabled, running, *values = struct.unpack(f"{3 + num_events}Q", buf)
+    assert nr == num_events, f"{nr=} != {num_events=}"
+    values = np.array(values, dtype=np.float64)
+    if 0 < running < enabled:
+        # * The group was multiplexed, extrapolate to the full window.
+        values *= enabled / running
+    return values
+
+
+def read_single(fd: int) -> float:
+    """Reads one counter with {value, time_enabled, time_running}."""
+    value, enabled, running = struct.unpack("3Q", os.read(fd, 24))
+    if 0 < running < enabled:
+        return value * enabled / running
+    return float(value)
+
+
+def open_group(
+    events: Sequence[int], pid: int, cpu: int, attr_flags: int = 0, flags: int = 0
+) -> List[int]:
+    """Opens hardware `events` as one group (the first one is the leader).
+
+    :return: {List[int]} [leader fd, member fds...]
+    """
+    read_format = (
+        PERF_FORMAT_GROUP
+        | PERF_FORMAT_TOTAL_TIME_ENABLED
+        | PERF_FORMAT_TOTAL_TIME_RUNNING
+    )
+    fds = []
+    try:
+        for event in events:
+            attr = make_attr(PERF_TYPE_HARDWARE, event, read_format, attr_flags)
+            group_fd = fds[0] if fds else -1
+            fds.append(perf_event_open(attr, pid, cpu, group_fd, flags))
+    except OSError:
+        for fd in fds:
+            os.close(fd)
+        raise
+    return fds
+
+
+def resolve_cgroup_path(cgroup: str) -> str:
+    """Accepts either an absolute cgroupfs path or one relative to the v2 root."""
+    if os.path.isabs(cgroup) and os.path.isdir(cgroup):
+        return cgroup
+    return os.path.join("/sys/fs/cgroup", cgroup.lstrip("/"))
+
+
+def raise_fd_limit(num_fds: int):
+    """Lifts the soft limit of open files to the hard limit if `num_fds` more
+    (e.g., one per event of each counter group) don't fit under it."""
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    needed = len(os.listdir("/proc/self/fd")) + num_fds
+    if soft < hard and needed > soft:
+        resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))
+    if hard != resource.RLIM_INFINITY and needed > hard:
+        logger.warning(f"{num_fds} fds may exceed the limit of open files ({hard})")
+
+
+class SystemCycles(object):
+    """System-wide unhalted cycles per socket (the denominator of cycle shares)."""
+
+    def __init__(self, core_pkg_map: Dict[int, int]):
+        self.core_pkg_map = core_pkg_map
+        self.num_sockets = len(set(core_pkg_map.values()))
+        # * CPU -> system-wide cycles fd.
+        self.fds: Dict[int, int] = {}
+        try:
+            for cpu in core_pkg_map:
+                attr = make_attr(
+                    PERF_TYPE_HARDWARE,
+                    PERF_COUNT_HW_CPU_CYCLES,
+                    PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING,
+                )
+                self.fds[cpu] = perf_event_open(attr, -1, cpu)
+        except OSError:
+            self.close()
+            raise
+        self.last_cycles = self.read_cycles()
+
+    def read_cycles(self) -> np.ndarray:
+        """Reads the cumulative cycles folded into sockets."""
+        cycles = np.zeros(self.num_sockets)
+        for cpu, fd in self.fds.items():
+            cycles[self.core_pkg_map[cpu]] += read_single(fd)
+        return cycles
+
+    def read_deltas(self) -> np.ndarray:
+        """:return: {np.ndarray} [num_sockets x 1] cycles since the last call."""
+        cycles = self.read_cycles()
+        delta = cycles - self.last_cycles
+        self.last_cycles = cycles
+        return delta
+
+    def close(self):
+        for fd in self.fds.values():
+            os.close(fd)
+        self.fds = {}
+
+
+class CgroupCounters(object):
+    """Per-cgroup cycle/instruction counters on every CPU.
+
+    Each CPU gets one group {cycles, instructions} scoped to the cgroup
+    (`PERF_FLAG_PID_CGROUP`) and one system-wide cycles counter as the reference.
+    The cost of a read is independent of the number of threads in the cgroup.
+    """
+
+    GROUP_EVENTS = (PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS)
+
+    def __init__(self, cgroup: str, core_pkg_map: Dict[int, int]):
+        self.cgroup_path = resolve_cgroup_path(cgroup)
+        self.core_pkg_map = core_pkg_map
+        self.num_sockets = len(set(core_pkg_map.values()))
+        self.cgroup_fd = os.open(self.cgroup_path, os.O_RDONLY)
+
+        # * CPU -> [leader fd, member fds...]
+        self.group_fds: Dict[int, List[int]] = {}
+        self.system: SystemCycles = None
+        try:
+            for cpu in core_pkg_map:
+                self.group_fds[cpu] = open_group(
+                    self.GROUP_EVENTS, self.cgroup_fd, cpu, flags=PERF_FLAG_PID_CGROUP
+                )
+            self.system = SystemCycles(core_pkg_map)
+        except OSError:
+            self.close()
+            raise
+
+        # * [num_sockets x (cycles, instructions)] of the cgroup.
+        self.last_cgroup_counts = self.read_counts()
+        logger.info(
+            f"Opened cgroup counters for {self.cgroup_path} on {len(self.group_fds)} CPUs"
+        )
+
+    def read_counts(self):
+        """Reads the cumulative counts folded into sockets."""
+        cgroup_counts = np.zeros((self.num_sockets, len(self.GROUP_EVENTS)))
+        for cpu, fds in self.group_fds.items():
+            cgroup_counts[self.core_pkg_map[cpu]] += read_group(fds[0], len(fds))
+        return cgroup_counts
+
+    def read_credit_fracs(self):
+        """Computes the cgroup's share of unhalted cycles per socket since the last call.
+
+        :return: {Tuple[np.ndarray, np.ndarray]} ([num_sockets] cycle shares,
+            [num_sockets x (cycles, instructions)] deltas of the cgroup)
+        """
+        cgroup_counts = self.read_counts()
+        cgroup_delta = cgroup_counts - self.last_cgroup_counts
+        system_delta = self.system.read_deltas()
+        self.last_cgroup_counts = cgroup_counts
+
+        fracs = np.zeros(self.num_sockets)
+        has_cycles = system_delta > 0
+        fracs[has_cycles] = np.minimum(
+            1.0, cgroup_delta[has_cycles, 0] / system_delta[has_cycles]
+        )
+        return fracs, cgroup_delta
+
+    def close(self):
+        for fds in self.group_fds.values():
+            for fd in fds:
+                os.close(fd)
+        self.group_fds = {}
+        if self.system:
+            self.system.close()
+            self.system = None
+        if self.cgroup_fd >= 0:
+            os.close(self.cgroup_fd)
+            self.cgroup_fd = -1
+
+
+class ThreadCounters(object):
+    """Per-thread {cycles, instructions, ref-cycles, LLC misses} groups.
+
+    Every target gets its own group once it is found, and loses it once it has
+    departed. Groups are not inherited: the kernel only adds the counts of an
+    inherited child to its parent's group when the child exits, so live children
+    would be missed until then (and counted twice once they have their own
+    group). Tasks living shorter than the discovery period are missed, as their
+    cputime is. Each interval costs one read(2) per group, which is no more than
+    reading one stat file per target.
+    """
+
+    GROUP_EVENTS = (
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_REF_CPU_CYCLES,
+        PERF_COUNT_HW_CACHE_MISSES,
+    )
+
+    def __init__(self, core_pkg_map: Dict[int, int]):
+        # * TID -> [leader fd, member fds...]
+        self.group_fds: Dict[int, List[int]] = {}
+        # * TID -> cumulative `GROUP_EVENTS` counts.
+        self.last_counts: Dict[int, np.ndarray] = {}
+        # * TID -> last deltas of detached groups (reported by the next read).
+        self.detached_deltas: Dict[int, np.ndarray] = {}
+        self.system = SystemCycles(core_pkg_map)
+
+    def attach(self, tids: Iterable[int]):
+        """Opens counter groups for `tids` not attached yet.
+
+        :return: {int} Number of newly attached threads.
+        """
+        tids = [tid for tid in tids if tid not in self.group_fds]
+        # * One fd per event of each group.
+        raise_fd_limit(len(tids) * len(self.GROUP_EVENTS))
+        attached = 0
+        for tid in tids:
+            try:
+                fds = open_group(self.GROUP_EVENTS, tid, -1)
+            except OSError as e:
+                logger.warning(f"Failed to attach counters to {tid=}: {e}")
+                continue
+            self.group_fds[tid] = fds
+            self.last_counts[tid] = np.zeros(len(self.GROUP_EVENTS))
+            attached += 1
+        return attached
+
+    def read_deltas(self, tids: Iterable[int] = None):
+        """Reads each group once and returns the deltas since the last call
+        (including the last ones of groups detached since).
+
+        :param tids: Subset of attached threads to read (defaults to all).
+        :return: {Dict[int, np.ndarray]} TID -> `GROUP_EVENTS` deltas
+        """
+        deltas, self.detached_deltas = self.detached_deltas, {}
+        for tid in self.group_fds if tids is None else tids:
+            fds = self.group_fds.get(tid)
+            if not fds:
+                continue
+            counts = read_group(fds[0], len(fds))
+            deltas[tid] = counts - self.last_counts[tid]
+            self.last_counts[tid] = counts
+        return deltas
+
+    def detach(self, tid: int):
+        """Closes the group of a departed task, keeping its counts since the last
+        read (the group of an exited task stays readable until then)."""
+        fds = self.group_fds.pop(tid, None)
+        if not fds:
+            return
+        last_counts = self.last_counts.pop(tid)
+        try:
+            self.detached_deltas[tid] = read_group(fds[0], len(fds)) - last_counts
+        except OSError:
+            pass
+        for fd in fds:
+            os.close(fd)
+
+    def close(self):
+        for tid in list(self.group_fds):
+            self.detach(tid)
+        self.system.close()
+
+
+PMU_DEVICES_DIR = "/sys/bus/event_source/devices"
+
+
+def parse_pmu_event(pmu_dir: str, event: str) -> int:
+    """Encodes a sysfs PMU event (e.g., "event=0x04,umask=0x03") into `config`.
+
+    Field positions come from the PMU's `format/` directory (e.g., "config:8-15").
+    """
+    with open(f"{pmu_dir}/events/{event}", "r") as f:
+        terms = f.read().strip().split(",")
+
+    config = 0
+    for term in terms:
+        name, _, value = term.partition("=")
+        value = int(value, 0) if value else 1
+        with open(f"{pmu_dir}/format/{name}", "r") as f:
+            field, bits = f.read().strip().split(":")
+        assert field == "config", f"Unsupported format {field=} of {event}"
+        low = int(bits.split("-")[0])
+        config |= value << low
+    return config
+
+
+class ImcCounters(object):
+    """Per-socket DRAM CAS counts from the uncore integrated memory controllers.
+
+    Each `uncore_imc_*` PMU is opened once per socket on the CPU its `cpumask` names.
+    """
+
+    EVENTS = ("cas_count_read", "cas_count_write")
+
+    def __init__(self, core_pkg_map: Dict[int, int]):
+        self.core_pkg_map = core_pkg_map
+        self.num_sockets = len(set(core_pkg_map.values()))
+        # * (socket, fd) of every opened IMC event.
+        self.fds: List[Tuple[int, int]] = []
+
+        pmus = sorted(
+            d for d in os.listdir(PMU_DEVICES_DIR) if d.startswith("uncore_imc")
+        )
+        if not pmus:
+            raise OSError("No uncore IMC PMUs found")
+        try:
+            for pmu in pmus:
+                pmu_dir = f"{PMU_DEVICES_DIR}/{pmu}"
+                with open(f"{pmu_dir}/type", "r") as f:
+                    pmu_type = int(f.read())
+                with open(f"{pmu_dir}/cpumask", "r") as f:
+                    cpus = parse_cpu_list(f.read())
+                for event in self.EVENTS:
+                    attr = make_attr(
+                        pmu_type,
+                        parse_pmu_event(pmu_dir, event),
+                        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING,
+                    )
+                    # * Uncore events don't support excluding the hypervisor.
+                    attr.flags = 0
+                    for cpu in sorted(cpus):
+                        fd = perf_event_open(attr, -1, cpu)
+                        self.fds.append((core_pkg_map[cpu], fd))
+        except (OSError, ValueError, AssertionError):
+            self.close()
+            raise
+        self.last_lines = self.read_lines()
+        logger.info(f"Opened {len(self.fds)} IMC counters on {len(pmus)} PMUs")
+
+    def read_lines(self) -> np.ndarray:
+        """Reads cumulative read+write CAS counts (64-byte lines) per socket."""
+        lines = np.zeros(self.num_sockets)
+        for socket, fd in self.fds:
+            lines[socket] += read_single(fd)
+        return lines
+
+    def read_deltas(self) -> np.ndarray:
+        """:return: {np.ndarray} [num_sockets x 1] DRAM lines since the last call."""
+        lines = self.read_lines()
+        delta = lines - self.last_lines
+        self.last_lines = lines
+        return delta
+
+    def close(self):
+        for _, fd in self.fds:
+            os.close(fd)
+        self.fds = []
@@ -0,0 +1,316 @@
+import os
+from typing import *
+
+import numpy as np
+
+from energat.common import CLK_TCK_PER_SEC
+
+"""Per-CPU time categories of /proc/stat, in the kernel's column order."""
+PROC_STAT_FIELDS = (
+    "user",
+    "nice",
+    "system",
+    "idle",
+    "iowait",
+    "irq",
+    "softirq",
+    "steal",
+    "guest",
+    "guest_nice",
+)
+FIELD_INDEX = {field: i for i, field in enumerate(PROC_STAT_FIELDS)}
+
+
+class ProcStatReader(object):
+    """Reads the per-CPU times of /proc/stat and folds them into sockets.
+
+    The file stays open and is re-read with `pread()` at offset 0, and the per-CPU
+    lines are parsed in one pass as a [num_cpus x num_fields] matrix. Offline CPUs
+    are missing from /proc/stat, so rows are matched by their CPU ids, and CPUs
+    outside of `core_pkg_map` are ignored.
+    """
+
+    def __init__(self, core_pkg_map: Dict[int, int], path: str = "/proc/stat"):
+        self.num_sockets = len(set(core_pkg_map.values()))
+        # * [CPU id x socket] one-hot table (zero rows for unknown CPUs).
+        self.fold = np.zeros((max(core_pkg_map) + 1, self.num_sockets))
+        for cpu, socket in core_pkg_map.items():
+            self.fold[cpu, socket] = 1.0
+        self.fd = os.open(path, os.O_RDONLY | os.O_CLOEXEC)
+        self.bufsize = 1 << 16
+
+    def read_raw(self) -> bytes:
+        while True:
+            data = os.pread(self.fd, self.bufsize, 0)
+            if len(data) < self.bufsize:
+                return data
+            self.bufsize *= 2
+
+    def read_cpus(self) -> Tuple[np.ndarray, np.ndarray]:
+        """:return: ([n] CPU ids, [n x len(PROC_STAT_FIELDS)] times in seconds)"""
+        data = self.read_raw()
+        # * The aggregate "cpu " line comes first, followed by one line per CPU.
+        begin = data.index(b"\ncpu") + 1
+        end = data.index(b"\n", data.rindex(b"\ncpu") + 1)
+        block = data[begin:end]
+        width = block.split(b"\n", 1)[0].count(b" ")
+        values = np.fromstring(block.replace(b"cpu", b""), dtype=np.int64, sep=" ")
+        values = values.reshape(-1, width + 1)
+        # * Older kernels report fewer fields, newer ones may report more.
+        width = min(width, len(PROC_STAT_FIELDS))
+        times = np.zeros((values.shape[0], len(PROC_STAT_FIELDS)))
+        times[:, :width] = values[:, 1 : width + 1]
+        times /= CLK_TCK_PER_SEC
+        return values[:, 0], times
+
+    def read_sockets(self) -> np.ndarray:
+        """:return: {np.ndarray} [num_sockets x len(PROC_STAT_FIELDS)] times in seconds"""
+        cpus, times = self.read_cpus()
+        known = cpus < self.fold.shape[0]
+        return self.fold[cpus[known]].T @ times[known]
+
+    def close(self):
+        os.close(self.fd)
+
+
+"""Offsets of /proc/<pid>/stat fields after the command name (see proc(5))."""
+STAT_PPID, STAT_UTIME, STAT_STIME, STAT_PROCESSOR = 4 - 3, 14 - 3, 15 - 3, 39 - 3
+KTHREADD_PID = 2
+
+
+def parse_task_stat(stat: str) -> List[str]:
+    """Splits /proc/<pid>/stat after the command name (which may contain spaces)."""
+    return stat[stat.rindex(")") + 2 :].split()
+
+
+def parse_io_bytes(io: str) -> int:
+    """:return: {int} Bytes read and written through syscalls (network, storage and
+    other files) from /proc/<pid>/io."""
+    fields = dict(line.split(": ") for line in io.splitlines() if ": " in line)
+    return int(fields["rchar"]) + int(fields["wchar"])
+
+
+def parse_diskstats(diskstats: str, disks: Set[str]) -> int:
+    """:return: {int} Bytes read from and written to `disks` from /proc/diskstats."""
+    sectors = 0
+    for line in diskstats.splitlines():
+        fields = line.split()
+        if len(fields) > 9 and fields[2] in disks:
+            sectors += int(fields[5]) + int(fields[9])
+    return sectors * 512
+
+
+def parse_net_dev(net_dev: str) -> int:
+    """:return: {int} Bytes received and transmitted by all non-loopback interfaces
+    from /proc/net/dev."""
+    nbytes = 0
+    for line in net_dev.splitlines()[2:]:
+        iface, counters = line.split(":", 1)
+        if iface.strip() != "lo":
+            counters = counters.split()
+            nbytes += int(counters[0]) + int(counters[8])
+    return nbytes
+
+
+class KernelWork(object):
+    """Tracks kernel-thread runtime per socket and the I/O share of the targets.
+
+    Work of `ksoftirqd`, kworkers and other kernel threads is done on behalf of
+    whoever drives the I/O, so it is credited to the targets by their share of the
+    host's network and block I/O. Per-task bytes from /proc/<pid>/io count all
+    read/write syscalls, so the share is only a proxy (capped at 1).
+    """
+
+    def __init__(self, core_pkg_map: Dict[int, int], procfs: str = "/proc"):
+        self.procfs = procfs
+        self.core_pkg_map = core_pkg_map
+        self.num_sockets = len(set(core_pkg_map.values()))
+        # * Whole block devices (partitions and loop/ram devices are skipped).
+        self.disks = {
+            disk
+            for disk in (
+                os.listdir("/sys/block") if os.path.isdir("/sys/block") else []
+            )
+            if not disk.startswith(("loop", "ram"))
+        }
+        self.kthreads: Set[int] = set()
+        self.others: Set[int] = set()
+        # * Kernel thread -> last runtime (s).
+        self.last_runtime: Dict[int, float] = {}
+        # * Thread group -> last I/O bytes.
+        self.last_io: Dict[int, int] = {}
+        self.last_host_io = None
+
+    def read(self, path: str) -> str:
+        with open(f"{self.procfs}/{path}", "r") as f:
+            return f.read()
+
+    def refresh(self):
+        """Picks up new kernel threads (only new PIDs are inspected)."""
+        pids = {int(pid) for pid in os.listdir(self.procfs) if pid.isdigit()}
+        self.kthreads &= pids
+        self.others &= pids
+        for pid in pids - self.kthreads - self.others:
+            try:
+                ppid = int(parse_task_stat(self.read(f"{pid}/stat"))[STAT_PPID])
+            except (OSError, ValueError, IndexError):
+                continue
+            is_kthread = pid == KTHREADD_PID or ppid == KTHREADD_PID
+            (self.kthreads if is_kthread else self.others).add(pid)
+        for pid in self.last_runtime.keys() - self.kthreads:
+            self.last_runtime.pop(pid)
+
+    def read_kthread_deltas(self) -> np.ndarray:
+        """:return: {np.ndarray} [num_sockets] runtime (s) of kernel threads since
+        the last read, on the socket of their current CPU."""
+        per_socket = np.zeros(self.num_sockets)
+        for pid in self.kthreads:
+            try:
+                stat = parse_task_stat(self.read(f"{pid}/task/{pid}/stat"))
+            except (OSError, ValueError):
+                continue
+            runtime = (int(stat[STAT_UTIME]) + int(stat[STAT_STIME])) / CLK_TCK_PER_SEC
+            last = self.last_runtime.get(pid, runtime)
+            self.last_runtime[pid] = runtime
+            socket = self.core_pkg_map.get(int(stat[STAT_PROCESSOR]))
+            if socket is not None:
+                per_socket[socket] += runtime - last
+        return per_socket
+
+    def read_io_deltas(self, tgids: Iterable[int]) -> Tuple[int, int]:
+        """:return: {Tuple[int, int]} (I/O bytes of the thread groups `tgids`,
+        network and block I/O bytes of the host) since the last read."""
+        target_io = 0
+        tgids = set(tgids)
+        for tgid in self.last_io.keys() - tgids:
+            self.last_io.pop(tgid)
+        for tgid in tgids:
+            try:
+                nbytes = parse_io_bytes(self.read(f"{tgid}/io"))
+            except (OSError, KeyError, ValueError):
+                continue
+            target_io += nbytes - self.last_io.get(tgid, nbytes)
+            self.last_io[tgid] = nbytes
+
+        host_io = parse_diskstats(self.read("diskstats"), self.disks) + parse_net_dev(
+            self.read("net/dev")
+        )
+        last_host_io = host_io if self.last_host_io is None else self.last_host_io
+        self.last_host_io = host_io
+        return target_io, host_io - last_host_io
+
+    def io_share(self, tgids: Iterable[int]) -> float:
+        """:return: {float} Share of the host's I/O driven by `tgids` since the last
+        call (0 if the host did no I/O)."""
+        target_io, host_io = self.read_io_deltas(tgids)
+        return min(1.0, target_io / host_io) if host_io > 0 else 0.0
+
+
+def parse_cpu_list(cpu_list: str) -> Set[int]:
+    """Parses a kernel CPU list (e.g., "0-3,8,10-11")."""
+    cpus = set()
+    for part in cpu_list.strip().split(","):
+        if not part:
+            continue
+        first, _, last = part.partition("-")
+        cpus.update(range(int(first), int(last or first) + 1))
+    return cpus
+
+
+def parse_cpuset_cgroup(cgroup: str) -> Tuple[str, str]:
+    """:return: {Tuple[str, str]} (cpuset file relative to the cgroupfs root, cgroup
+    path) of a task from /proc/<pid>/cgroup (v1 cpuset controller or v2)."""
+    unified = None
+    for line in cgroup.splitlines():
+        _, controllers, path = line.split(":", 2)
+        if "cpuset" in controllers.split(","):
+            return "cpuset", path + "/cpuset.effective_cpus"
+        if controllers == "":
+            unified = path + "/cpuset.cpus.effective"
+    return "", unified or ""
+
+
+class CpuPlacement(object):
+    """Infers the socket of tasks that can only run on one socket.
+
+    The CPUs a task may run on are its affinity mask (`sched_getaffinity()`)
+    restricted to the effective cpuset of its cgroup. They are read once per task
+    and re-read only when the cpuset of its cgroup changes or `invalidate()` is
+    called (e.g., once the task is seen running elsewhere).
+    """
+
+    def __init__(
+        self,
+        core_pkg_map: Dict[int, int],
+        procfs: str = "/proc",
+        cgroupfs: str = "/sys/fs/cgroup",
+        getaffinity: Callable[[int], Set[int]] = os.sched_getaffinity,
+    ):
+        self.core_pkg_map = core_pkg_map
+        self.procfs = procfs
+        self.cgroupfs = cgroupfs
+        self.getaffinity = getaffinity
+        # * Task -> (cpuset file, socket or -1 if the task may migrate).
+        self.tasks: Dict[int, Tuple[str, int]] = {}
+        # * Cpuset file -> its contents as of the last refresh (None if unreadable).
+        self.cpusets: Dict[str, Optional[str]] = {}
+
+    def read_cpuset(self, path: str) -> Optional[str]:
+        try:
+            with open(path, "r") as f:
+                return f.read().strip() or None
+        except OSError:
+            return None
+
+    def cpuset_of(self, tid: int) -> str:
+        try:
+            with open(f"{self.procfs}/{tid}/cgroup", "r") as f:
+                controller, path = parse_cpuset_cgroup(f.read())
+        except (OSError, ValueError):
+            return ""
+        return os.path.join(self.cgroupfs, controller, path.lstrip("/")) if path else ""
+
+    def socket_of(self, tid: int, cpuset: str) -> int:
+        """:return: {int} Socket of the CPUs `tid` may run on (-1 if several)."""
+        cpus = set(self.getaffinity(tid))
+        if self.cpusets.get(cpuset):
+            cpus &= parse_cpu_list(self.cpusets[cpuset])
+        sockets = {self.core_pkg_map[cpu] for cpu in cpus if cpu in self.core_pkg_map}
+        return sockets.pop() if len(sockets) == 1 else -1
+
+    def refresh(self, tids: Iterable[int]) -> Dict[int, int]:
+        """Places new tasks and re-places those whose cpuset has changed.
+
+        :return: {Dict[int, int]} Task -> socket (or -1) of tasks placed anew.
+        """
+        tids = set(tids)
+        for tid in self.tasks.keys() - tids:
+            self.tasks.pop(tid)
+        cpusets = {cpuset for cpuset, _ in self.tasks.values()}
+        for cpuset in self.cpusets.keys() - cpusets:
+            self.cpusets.pop(cpuset)
+        changed = {
+            cpuset
+            for cpuset, contents in self.cpusets.items()
+            if self.read_cpuset(cpuset) != contents
+        }
+
+        placed = {}
+        for tid in tids:
+            if tid in self.tasks and self.tasks[tid][0] not in changed:
+                continue
+            cpuset = self.cpuset_of(tid)
+            if cpuset and (cpuset in changed or cpuset not in self.cpusets):
+                self.cpusets[cpuset] = self.read_cpuset(cpuset)
+            try:
+                socket = self.socket_of(tid, cpuset)
+            except OSError:
+                continue
+            if self.tasks.get(tid, (None, None))[1] != socket:
+                placed[tid] = socket
+            self.tasks[tid] = (cpuset, socket)
+        return placed
+
+    def invalidate(self, tid: int):
+        """Re-places `tid` at the next `refresh()`."""
+        self.tasks.pop(tid, None)
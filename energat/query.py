@@ -0,0 +1,305 @@
+import glob
+import multiprocessing
+import operator
+import os
+import re
+import sys
+from typing import *
+
+import numpy as np
+import pandas as pd
+from absl import app, flags
+
+from energat.segments import load_index, read_blocks
+from energat.sketch import QuantileSketch
+from energat.traceio import TraceReader
+
+try:
+    import pyarrow
+except ImportError:
+    pyarrow = None
+
+"""Aggregates over trace files (CSV, binary or segmented), e.g.:
+
+    energat-query -group_by socket -agg sum:ascribed_pkg_joules,p99:total_dram_joules \
+        -where "time>=1792245600" ./data/results/*.etr
+
+Files are read in parallel, one task per file (or segment), keeping only the
+columns in use: binary traces straight from their mapping (skipping row groups
+out of the time range), CSV traces with the multithreaded pyarrow parser if
+installed (the pandas C parser otherwise). Each task filters
+and reduces its rows per group with vectorized NumPy, and the partial results
+are merged. Quantiles are estimated with mergeable sketches (within `alpha`).
+"""
+FLAGS = flags.FLAGS
+
+flags.DEFINE_list(
+    "agg",
+    ["count:time"],
+    "Aggregates as FUNC:COLUMN, with FUNC in count/sum/mean/min/max/pNN",
+)
+flags.DEFINE_list("group_by", [], "Columns to group by")
+flags.DEFINE_multi_string(
+    "where", [], "Filters as COLUMN OP VALUE, with OP in ==/!=/</<=/>/>="
+)
+flags.DEFINE_float("since", -np.inf, "Only records at or after this time")
+flags.DEFINE_float("until", np.inf, "Only records at or before this time")
+flags.DEFINE_integer("workers", 0, "Worker processes (0 for one per CPU)")
+flags.DEFINE_float("alpha", 0.01, "Relative accuracy of quantiles")
+flags.DEFINE_enum("out_format", "table", ["table", "csv"], "Output format")
+
+OPERATORS = {
+    "==": operator.eq,
+    "!=": operator.ne,
+    "<=": operator.le,
+    ">=": operator.ge,
+    "<": operator.lt,
+    ">": operator.gt,
+}
+FILTER = re.compile(r"^\s*(\w+)\s*(==|!=|<=|>=|<|>)\s*(.+?)\s*$")
+QUANTILE = re.compile(r"^p(\d+(?:\.\d+)?)$")
+
+
+class Query(NamedTuple):
+    group_by: List[str]
+    # * (function, column)
+    aggs: List[Tuple[str, str]]
+    # * (column, operator, value)
+    filters: List[Tuple[str, str, Any]]
+    t0: float = -np.inf
+    t1: float = np.inf
+    alpha: float = 0.01
+
+    @property
+    def columns(self) -> List[str]:
+        """Columns to read."""
+        columns = self.group_by + [column for _, column in self.aggs]
+        columns += [column for column, *_ in self.filters]
+        if np.isfinite(self.t0) or np.isfinite(self.t1):
+            columns.append("time")
+        return list(dict.fromkeys(columns))
+
+
+def parse_query(
+    group_by: List[str],
+    aggs: List[str],
+    where: List[str] = (),
+    t0: float = -np.inf,
+    t1: float = np.inf,
+    alpha: float = 0.01,
+) -> Query:
+    parsed_aggs = []
+    for agg in aggs:
+        func, _, column = agg.partition(":")
+        if func not in ("count", "sum", "mean", "min", "max") and not QUANTILE.match(
+            func
+        ):
+            raise ValueError(f"Unknown aggregate: {agg}")
+        parsed_aggs.append((func, column))
+    filters = []
+    for condition in where:
+        match = FILTER.match(condition)
+        if not match:
+            raise ValueError(f"Invalid filter: {condition}")
+        column, op, value = match.groups()
+        try:
+            value = float(value)
+        except ValueError:
+            value = value.strip("'\"")
+        filters.append((column, op, value))
+    return Query(list(group_by), parsed_aggs, filters, t0, t1, alpha)
+
+
+def read_columns(
+    source: Tuple[str, Any], columns: List[str], t0: float, t1: float
+) -> Dict[str, np.ndarray]:
+    """Reads `columns` of one task: (path, None) for a file, or (directory,
+    blocks) for a segment of segmented traces."""
+    path, blocks = source
+    if blocks is not None:
+        df = read_blocks(path, blocks[0]["segment"], blocks)
+        return {column: df[column].to_numpy() for column in columns}
+    if path.endswith(".csv"):
+        df = pd.read_csv(
+            path,
+            usecols=columns,
+            **(dict(engine="pyarrow") if pyarrow else dict(memory_map=True)),
+        )
+        return {column: df[column].to_numpy() for column in columns}
+    with TraceReader(path) as reader:
+        # * Skip row groups out of the time range (by the index).
+        groups = [
+            i
+            for i, group in enumerate(reader.groups)
+            if group["time"] is None
+            or (group["time"][1] >= t0 and group["time"][0] <= t1)
+        ]
+        # * Copied out of the mapping (only the row groups in range).
+        return {column: np.array(reader.column(column, groups)) for column in columns}
+
+
+def reduce_source(query: Query, source: Tuple[str, Any]) -> Dict[Tuple, Dict]:
+    """:return: {Dict} Group key -> partial aggregates of one task."""
+    data = read_columns(source, query.columns, query.t0, query.t1)
+    keep = np.ones(len(next(iter(data.values()))), dtype=bool)
+    if "time" in data and (np.isfinite(query.t0) or np.isfinite(query.t1)):
+        keep &= (data["time"] >= query.t0) & (data["time"] <= query.t1)
+    for column, op, value in query.filters:
+        keep &= OPERATORS[op](data[column], value)
+    data = {column: values[keep] for column, values in data.items()}
+    num_rows = int(keep.sum())
+    if num_rows == 0:
+        return {}
+
+    """Grouping rows by sorting their keys."""
+    if query.group_by:
+        # * Rows are coded by the combination of their keys' codes per column.
+        keys = [
+            np.unique(data[column], return_inverse=True) for column in query.group_by
+        ]
+        sizes = [uniques.size for uniques, _ in keys]
+        codes = np.ravel_multi_index([inverse.ravel() for _, inverse in keys], sizes)
+        group_codes, inverse = np.unique(codes, return_inverse=True)
+        inverse = inverse.ravel()
+        group_keys = list(
+            zip(
+                *[
+                    uniques[indices].tolist()
+                    for (uniques, _), indices in zip(
+                        keys, np.unravel_index(group_codes, sizes)
+                    )
+                ]
+            )
+        )
+    else:
+        inverse = np.zeros(num_rows, dtype=np.int64)
+        group_keys = [()]
+    order = np.argsort(inverse, kind="stable")
+    starts = np.searchsorted(inverse[order], np.arange(len(group_keys)))
+    counts = np.bincount(inverse, minlength=len(group_keys))
+
+    partials = {key: {"count": int(count)} for key, count in zip(group_keys, counts)}
+    for func, column in query.aggs:
+        if func == "count":
+            continue
+        values = data[column].astype(np.float64)[order]
+        if func in ("sum", "mean"):
+            results = np.add.reduceat(values, starts)
+            name = f"sum:{column}"
+        elif func in ("min", "max"):
+            results = (np.minimum if func == "min" else np.maximum).reduceat(
+                values, starts
+            )
+            name = f"{func}:{column}"
+        else:
+            results = []
+            for part in np.split(values, starts[1:]):
+                sketch = QuantileSketch(query.alpha)
+                sketch.add(part)
+                results.append(sketch)
+            name = f"sketch:{column}"
+        for key, result in zip(group_keys, results):
+            partials[key][name] = result
+    return partials
+
+
+def merge_partials(into: Dict[Tuple, Dict], partials: Dict[Tuple, Dict]):
+    for key, partial in partials.items():
+        if key not in into:
+            into[key] = partial
+            continue
+        merged = into[key]
+        for name, value in partial.items():
+            func = name.partition(":")[0]
+            if func == "sketch":
+                merged[name].merge(value)
+            elif func == "min":
+                merged[name] = min(merged[name], value)
+            elif func == "max":
+                merged[name] = max(merged[name], value)
+            else:
+                merged[name] += value
+
+
+def list_sources(paths: Iterable[str], t0: float, t1: float) -> List[Tuple]:
+    """Expands globs into tasks: one per file, or per segment of a directory."""
+    sources = []
+    for pattern in paths:
+        for path in sorted(glob.glob(pattern)) or [pattern]:
+            if not os.path.isdir(path):
+                sources.append((path, None))
+                continue
+            blocks = [
+                block
+                for block in load_index(path)
+                if block["time"][1] >= t0 and block["time"][0] <= t1
+            ]
+            for segment in dict.fromkeys(block["segment"] for block in blocks):
+                sources.append(
+                    (path, [block for block in blocks if block["segment"] == segment])
+                )
+    return sources
+
+
+def aggregate(paths: Iterable[str], query: Query, workers: int = None) -> pd.DataFrame:
+    """Runs `query` over trace files (spread over `workers` processes).
+
+    :return: {pd.DataFrame} One row per group, with a column per aggregate
+        (named FUNC:COLUMN).
+    """
+    sources = list_sources(paths, query.t0, query.t1)
+    merged: Dict[Tuple, Dict] = {}
+    if workers == 1 or len(sources) <= 1:
+        for source in sources:
+            merge_partials(merged, reduce_source(query, source))
+    else:
+        with multiprocessing.Pool(min(workers or os.cpu_count(), len(sources))) as pool:
+            for partials in pool.starmap(
+                reduce_source, [(query, source) for source in sources]
+            ):
+                merge_partials(merged, partials)
+
+    rows = []
+    for key in sorted(merged):
+        partial = merged[key]
+        row = dict(zip(query.group_by, key))
+        for func, column in query.aggs:
+            name = f"{func}:{column}"
+            if func == "count":
+                row[name] = partial["count"]
+            elif func == "sum":
+                row[name] = partial[name]
+            elif func == "mean":
+                row[name] = partial[f"sum:{column}"] / partial["count"]
+            elif func in ("min", "max"):
+                row[name] = partial[name]
+            else:
+                q = float(QUANTILE.match(func).group(1)) / 100
+                row[name] = partial[f"sketch:{column}"].quantile(q)
+        rows.append(row)
+    return pd.DataFrame(
+        rows, columns=query.group_by + [f"{func}:{col}" for func, col in query.aggs]
+    )
+
+
+def main(argv: List[str]):
+    if len(argv) < 2:
+        print("Usage: energat-query [flags] TRACES...", file=sys.stderr)
+        return 1
+    query = parse_query(
+        FLAGS.group_by, FLAGS.agg, FLAGS.where, FLAGS.since, FLAGS.until, FLAGS.alpha
+    )
+    df = aggregate(argv[1:], query, FLAGS.workers)
+    if FLAGS.out_format == "csv":
+        df.to_csv(sys.stdout, index=False)
+    else:
+        print(df.to_string(index=False))
+    return 0
+
+
+def run():
+    app.run(main)
+
+
+if __name__ == "__main__":
+    run()
@@ -0,0 +1,151 @@
+import json
+from multiprocessing import shared_memory
+from typing import *
+
+import numpy as np
+import pandas as pd
+
+"""Shared-memory layout of a trace ring:
+
+    head, capacity, max_columns (uint64) | padding to 64 bytes
+    | column names (JSON, NAMES_SIZE bytes) | [max_columns x capacity] float64
+
+
+`head` counts the rows appended so far; row `i` lives at `i % capacity` of every
+column. Each column is contiguous, so a run of rows is a view of it.
+"""
+HEADER_SIZE = 64
+NAMES_SIZE = 4096
+
+
+class TraceRing(object):
+    """The latest `capacity` trace records in shared memory, as float64 columns.
+
+    The tracer process appends records (numeric fields only, columns fixed by the
+    first record); any other process attached by `name` reads them as NumPy
+    views of the shared block (no copy, no parsing). There is a single writer,
+    which never waits: rows older than `capacity` are overwritten, so readers
+    check `overrun()` after using views of old rows.
+    """
+
+    def __init__(self, capacity: int = 4096, max_columns: int = 32, name: str = None):
+        self.owner = name is None
+        size = HEADER_SIZE + NAMES_SIZE + 8 * capacity * max_columns
+        self.shm = shared_memory.SharedMemory(name=name, create=self.owner, size=size)
+        if not self.owner:
+            # * The block may be larger than requested (rounded to pages).
+            capacity, max_columns = self.read_shape()
+        self.capacity = capacity
+        self.max_columns = max_columns
+        self.head = np.ndarray((3,), dtype=np.uint64, buffer=self.shm.buf)
+        self.data = np.ndarray(
+            (max_columns, capacity),
+            dtype=np.float64,
+            buffer=self.shm.buf,
+            offset=HEADER_SIZE + NAMES_SIZE,
+        )
+        self.columns: List[str] = []
+        if self.owner:
+            # * [rows appended, capacity, max_columns]
+            self.head[:] = [0, capacity, max_columns]
+            self.shm.buf[HEADER_SIZE : HEADER_SIZE + NAMES_SIZE] = b"\0" * NAMES_SIZE
+
+    def read_shape(self) -> Tuple[int, int]:
+        _, capacity, max_columns = np.ndarray(
+            (3,), dtype=np.uint64, buffer=self.shm.buf
+        ).tolist()
+        return capacity, max_columns
+
+    @property
+    def name(self) -> str:
+        """Name to attach to the same ring from another process."""
+        return self.shm.name
+
+    @property
+    def num_rows(self) -> int:
+        """Rows appended so far (including overwritten ones)."""
+        return int(self.head[0])
+
+    """Writer side."""
+
+    def append(self, records: List[Dict[str, Any]]):
+        if not records:
+            return
+        if not self.columns:
+            columns = [
+                column
+                for column, value in records[0].items()
+                if isinstance(value, (int, float, np.number))
+            ][: self.max_columns]
+            names = json.dumps(columns).encode()
+            assert len(names) <= NAMES_SIZE, f"{len(names)=}"
+            self.shm.buf[HEADER_SIZE : HEADER_SIZE + len(names)] = names
+            self.columns = columns
+
+        head = self.num_rows
+        rows = (head + np.arange(len(records))) % self.capacity
+        for i, column in enumerate(self.columns):
+            self.data[i, rows] = [record[column] for record in records]
+        # * Publish the rows once written.
+        self.head[0] = head + len(records)
+
+    """Reader side."""
+
+    def read_columns(self) -> List[str]:
+        if not self.columns:
+            names = bytes(self.shm.buf[HEADER_SIZE : HEADER_SIZE + NAMES_SIZE])
+            names = names.rstrip(b"\0")
+            self.columns = json.loads(names) if names else []
+        return self.columns
+
+    def overrun(self, start: int) -> bool:
+        """:return: {bool} If row `start` has been overwritten."""
+        return self.num_rows - start > self.capacity
+
+    def read(self, start: int = 0, stop: int = None) -> Tuple[int, Dict]:
+        """Views the next run of rows in [start, stop) (from the oldest row kept,
+        up to the latest one by default).
+
+        A run stops at the end of the ring, so callers read up to `stop` by
+        calling again with the returned position until it reaches `stop`.
+
+        :return: {Tuple} (position after the run, column -> view of the run)
+        """
+        stop = self.num_rows if stop is None else stop
+        start = max(start, stop - self.capacity)
+        begin = start % self.capacity
+        num_rows = max(0, min(stop - start, self.capacity - begin))
+        return start + num_rows, {
+            column: self.data[i, begin : begin + num_rows]
+            for i, column in enumerate(self.read_columns())
+        }
+
+    def to_dataframe(self, start: int = 0) -> pd.DataFrame:
+        """:return: {pd.DataFrame} Rows from `start` to the latest one, wrapping
+        the shared columns without copy unless the rows wrap around the ring."""
+        stop = self.num_rows
+        parts = []
+        while True:
+            start, views = self.read(start, stop)
+            parts.append(views)
+            if start >= stop:
+                break
+        if len(parts) == 1:
+            return pd.DataFrame(parts[0], copy=False)
+        return pd.DataFrame(
+            {
+                column: np.concatenate([part[column] for part in parts])
+                for column in parts[0]
+            }
+        )
+
+    def unlink(self):
+        """Removes the name of the block (mappings stay valid until closed)."""
+        self.shm.unlink()
+
+    def close(self, unlink: bool = None):
+        """Unmaps the block (all views must be gone by then)."""
+        self.head, self.data = None, None
+        self.shm.close()
+        if self.owner if unlink is None else unlink:
+            self.unlink()
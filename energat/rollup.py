@@ -0,0 +1,118 @@
+import math
+from typing import *
+
+from energat.sketch import QuantileSketch
+
+"""Rollup levels: name -> window width in seconds."""
+LEVELS = {"1s": 1.0, "1min": 60.0, "1h": 3600.0}
+QUANTILES = (0.5, 0.9, 0.99)
+
+
+class Aggregate(object):
+    """Energy and power statistics of one key in one window."""
+
+    __slots__ = ("joules", "count", "min_watts", "max_watts", "sketch")
+
+    def __init__(self, alpha: float):
+        self.joules = 0.0
+        self.count = 0
+        self.min_watts = math.inf
+        self.max_watts = -math.inf
+        self.sketch = QuantileSketch(alpha)
+
+    def add(self, joules: float, watts: float):
+        self.joules += joules
+        self.count += 1
+        self.min_watts = min(self.min_watts, watts)
+        self.max_watts = max(self.max_watts, watts)
+        self.sketch.add(watts)
+
+    def merge(self, other: "Aggregate"):
+        self.joules += other.joules
+        self.count += other.count
+        self.min_watts = min(self.min_watts, other.min_watts)
+        self.max_watts = max(self.max_watts, other.max_watts)
+        self.sketch.merge(other.sketch)
+
+
+class Rollups(object):
+    """Incremental rollups of interval energies over windows of several widths.
+
+    Samples are aggregated into the current window of the finest level. When a
+    window closes, its rows are emitted and its aggregates are merged into the
+    current window of the next level, so each level only ever sees the closed
+    windows of the level below.
+
+    :param emit: Called with (level name, rows) for every closed window.
+    """
+
+    def __init__(
+        self,
+        emit: Callable[[str, List[Dict[str, Any]]], Any],
+        levels: Dict[str, float] = LEVELS,
+        alpha: float = 0.01,
+    ):
+        self.emit = emit
+        self.alpha = alpha
+        self.levels = list(levels.items())
+        # * Start of the current window of each level (None before any sample).
+        self.starts: List[Optional[float]] = [None] * len(self.levels)
+        # * Key (socket, domain, tenant) -> aggregate, for each level.
+        self.aggregates: List[Dict[Tuple, Aggregate]] = [{} for _ in self.levels]
+
+    def add(self, t: float, key: Tuple, joules: float, duration_sec: float):
+        """Adds the energy of one interval that ended at `t`."""
+        self.advance(0, t)
+        aggregates = self.aggregates[0]
+        if key not in aggregates:
+            aggregates[key] = Aggregate(self.alpha)
+        aggregates[key].add(joules, joules / duration_sec)
+
+    def advance(self, level: int, t: float):
+        """Closes the current window of `level` if `t` is past it."""
+        start = math.floor(t / self.levels[level][1]) * self.levels[level][1]
+        if self.starts[level] is not None and start != self.starts[level]:
+            self.close(level)
+        self.starts[level] = start
+
+    def close(self, level: int):
+        name, _ = self.levels[level]
+        start, aggregates = self.starts[level], self.aggregates[level]
+        if not aggregates:
+            return
+        self.emit(
+            name,
+            [
+                {
+                    "time": start,
+                    "socket": socket,
+                    "domain": domain,
+                    "tenant": tenant,
+                    "count": agg.count,
+                    "joules": agg.joules,
+                    "min_watts": agg.min_watts,
+                    "max_watts": agg.max_watts,
+                    **{
+                        f"p{round(q * 100)}_watts": agg.sketch.quantile(q)
+                        for q in QUANTILES
+                    },
+                }
+                for (socket, domain, tenant), agg in aggregates.items()
+            ],
+        )
+        if level + 1 < len(self.levels):
+            self.advance(level + 1, start)
+            upper = self.aggregates[level + 1]
+            for key, agg in aggregates.items():
+                if key in upper:
+                    upper[key].merge(agg)
+                else:
+                    upper[key] = agg
+        self.aggregates[level] = {}
+
+    def flush(self):
+        """Closes the current windows of all levels (e.g., at the end of a run)."""
+        for level in range(len(self.levels)):
+            if self.starts[level] is not None:
+                self.close(level)
+                self.starts[level] = None
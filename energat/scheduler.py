@@ -0,0 +1,140 @@
+import heapq
+import math
+import time
+from typing import *
+
+from energat.common import logger
+
+
+class PeriodicTask(object):
+    """A callback released every `period` seconds, `phase` seconds after the start.
+
+    A run that finishes later than `deadline` seconds after its release is counted
+    as a miss, and releases that have passed in the meantime are skipped.
+    """
+
+    def __init__(
+        self,
+        name: str,
+        period: float,
+        callback: Callable[[], Any],
+        phase: float = 0.0,
+        deadline: float = None,
+    ):
+        assert period > 0, f"{name}: {period=}"
+        self.name = name
+        self.period = period
+        self.callback = callback
+        self.phase = phase
+        self.deadline = period if deadline is None else deadline
+        self.release = 0.0
+        self.runs = 0
+        self.misses = 0
+        self.skipped = 0
+        self.busy_sec = 0.0
+        # * Misses (and the worst lateness) not reported yet.
+        self.unreported = 0
+        self.worst_late_sec = 0.0
+
+    def __repr__(self):
+        return (
+            f"{self.name}(period={self.period}, phase={self.phase}, "
+            f"runs={self.runs}, misses={self.misses}, skipped={self.skipped}, "
+            f"busy={self.busy_sec:.3f}s)"
+        )
+
+
+class Scheduler(object):
+    """Cooperative multi-rate scheduler running periodic tasks on the calling thread.
+
+    Releases are kept in a min-heap ordered by (release time, order of `add()`),
+    so tasks released at the same time run in the order they were added. Tasks
+    must return quickly: the next release waits for the current run.
+
+    Deadline misses are logged as a summary at most every `report_sec` (and when
+    the run ends), not one line per miss.
+    """
+
+    def __init__(self, clock=time.perf_counter, sleep=time.sleep, report_sec=1.0):
+        self.clock = clock
+        self.sleep = sleep
+        self.report_sec = report_sec
+        self.reported = 0.0
+        self.tasks: List[PeriodicTask] = []
+        self.stopped = False
+
+    def add(
+        self,
+        name: str,
+        period: float,
+        callback: Callable[[], Any],
+        phase: float = 0.0,
+        deadline: float = None,
+    ) -> PeriodicTask:
+        task = PeriodicTask(name, period, callback, phase, deadline)
+        self.tasks.append(task)
+        return task
+
+    def stop(self):
+        """Stops the scheduler after the current run."""
+        self.stopped = True
+
+    def report_misses(self):
+        """Logs the misses since the last report."""
+        missed = [task for task in self.tasks if task.unreported]
+        if missed:
+            logger.warning(
+                "Deadline misses: "
+                + ", ".join(
+                    f"{task.name} x{task.unreported} "
+                    f"(worst {task.worst_late_sec:.4f}s late)"
+                    for task in missed
+                )
+            )
+        for task in missed:
+            task.unreported, task.worst_late_sec = 0, 0.0
+        self.reported = self.clock()
+
+    def run(self, duration: float = None):
+        """Runs the tasks until `stop()` is called (or for `duration` seconds).
+
+        :return: {float} Elapsed seconds.
+        """
+        start = self.reported = self.clock()
+        self.stopped = False
+        releases = []
+        for order, task in enumerate(self.tasks):
+            task.release = start + task.phase
+            heapq.heappush(releases, (task.release, order, task))
+
+        while releases and not self.stopped:
+            release, order, task = releases[0]
+            if duration is not None and release - start > duration:
+                break
+            wait = release - self.clock()
+            if wait > 0:
+                self.sleep(wait)
+                continue
+
+            began = self.clock()
+            task.callback()
+            finished = self.clock()
+            task.runs += 1
+            task.busy_sec += finished - began
+            if finished - release > task.deadline:
+                task.misses += 1
+                task.unreported += 1
+                task.worst_late_sec = max(
+                    task.worst_late_sec, finished - release - task.deadline
+                )
+                if finished - self.reported >= self.report_sec:
+                    self.report_misses()
+
+            # * Stay on the phase grid, skipping releases that have already passed.
+            lag = math.floor((finished - release) / task.period)
+            task.skipped += lag
+            task.release = release + (lag + 1) * task.period
+            heapq.heapreplace(releases, (task.release, order, task))
+
+        self.report_misses()
+        return self.clock() - start
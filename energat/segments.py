@@ -0,0 +1,218 @@
+import io
+import json
+import math
+import os
+from typing import *
+
+import numpy as np
+import pandas as pd
+
+from energat.traceio import TraceReader, TraceWriter
+
+"""Segmented traces: a directory of time-partitioned segment files
+
+    <start>.csv | <start>.etr    records whose time is in [start, start + segment_sec)
+    index.ndjson                 one line per block (batch) appended to a segment
+
+Every line of the index locates a block in its segment and summarizes it:
+{"segment", "offset", "length" (bytes), "rows", "time" ([min, max]), "tenants"
+(TGIDs of the targets traced in the block)}. A block of a CSV segment is its
+rows (the header is the first line of the segment); a block of a binary segment
+is one row group (see `energat.traceio`). Lines are appended once their block
+has been written, so a torn last line (or block) is ignored by readers.
+"""
+INDEX_FILE = "index.ndjson"
+EXTENSIONS = {"csv": ".csv", "binary": ".etr"}
+
+
+def read_index(directory: str) -> Tuple[List[Dict[str, Any]], int]:
+    """:return: {Tuple[List[Dict], int]} (all complete blocks of the index in
+    order, bytes of the index up to the end of their lines)"""
+    path = os.path.join(directory, INDEX_FILE)
+    if not os.path.isfile(path):
+        return [], 0
+    blocks, size = [], 0
+    with open(path, "rb") as f:
+        for line in f:
+            if not line.endswith(b"\n"):
+                break
+            blocks.append(json.loads(line))
+            size += len(line)
+    return blocks, size
+
+
+def load_index(directory: str) -> List[Dict[str, Any]]:
+    """:return: {List[Dict]} All complete blocks of the index, in order."""
+    return read_index(directory)[0]
+
+
+class SegmentWriter(object):
+    """Appends batches of records to time-partitioned segments of a directory.
+
+    Each batch is split by segment, appended as one block per segment, and then
+    indexed. Reopening a directory carries on after its last indexed block.
+
+    :param fmt: Format of the segments ("csv" or "binary").
+    """
+
+    def __init__(
+        self,
+        directory: str,
+        segment_sec: float,
+        fmt: str = "csv",
+        fsync_sec: float = 0.0,
+        fsync_bytes: int = 0,
+    ):
+        assert segment_sec >= 1, f"{segment_sec=}"
+        assert fmt in EXTENSIONS, f"{fmt=}"
+        os.makedirs(directory, exist_ok=True)
+        self.directory = directory
+        self.segment_sec = segment_sec
+        self.fmt = fmt
+        self.fsync_sec = fsync_sec
+        self.fsync_bytes = fsync_bytes
+        # * Segment -> end of its last indexed block.
+        self.ends: Dict[str, int] = {}
+        blocks, index_size = read_index(directory)
+        for block in blocks:
+            self.ends[block["segment"]] = block["offset"] + block["length"]
+        index_path = os.path.join(directory, INDEX_FILE)
+        self.index = open(index_path, "ab")
+        # * Drop a torn last line.
+        self.index.truncate(index_size)
+        self.segment: str = None
+        self.file: Union[IO[bytes], TraceWriter] = None
+
+    def segment_of(self, t: float) -> str:
+        start = math.floor(t / self.segment_sec) * self.segment_sec
+        return f"{start:.0f}{EXTENSIONS[self.fmt]}"
+
+    def open(self, segment: str):
+        """Switches to `segment`, dropping anything after its last indexed block."""
+        if segment == self.segment:
+            return
+        self.close_segment()
+        path = os.path.join(self.directory, segment)
+        if self.fmt == "binary":
+            # * `TraceWriter` itself drops torn frames (and the index of the file),
+            # * and complete frames after the last indexed block are dropped here.
+            if segment not in self.ends and os.path.isfile(path):
+                os.truncate(path, 0)
+            self.file = TraceWriter(path, self.fsync_sec, self.fsync_bytes)
+            if self.file.end > self.ends.get(segment, self.file.end):
+                self.file.truncate(self.ends[segment])
+        else:
+            self.file = open(path, "ab")
+            self.file.truncate(self.ends.get(segment, 0))
+            self.file.seek(0, os.SEEK_END)
+        self.segment = segment
+
+    def append(self, records: List[Dict[str, Any]], tenants: Iterable[int] = ()):
+        tenants = sorted(set(tenants))
+        segments = [self.segment_of(record["time"]) for record in records]
+        for segment in dict.fromkeys(segments):
+            self.open(segment)
+            block = [r for r, s in zip(records, segments) if s == segment]
+            offset, length = self.write(block)
+            times = [record["time"] for record in block]
+            entry = {
+                "segment": segment,
+                "offset": offset,
+                "length": length,
+                "rows": len(block),
+                "time": [min(times), max(times)],
+                "tenants": tenants,
+            }
+            self.index.write(json.dumps(entry).encode() + b"\n")
+            self.index.flush()
+            self.ends[segment] = offset + length
+
+    def write(self, records: List[Dict[str, Any]]) -> Tuple[int, int]:
+        """:return: {Tuple[int, int]} (offset, length) of the written block."""
+        if self.fmt == "binary":
+            self.file.append(records)
+            offset = self.file.groups[-1]["offset"]
+            return offset, self.file.end - offset
+        offset = self.file.tell()
+        data = pd.DataFrame(records).to_csv(header=offset == 0, index=False).encode()
+        if offset == 0:
+            # * The header belongs to the segment, not to the first block.
+            offset = data.index(b"\n") + 1
+        self.file.write(data)
+        self.file.flush()
+        return offset, self.file.tell() - offset
+
+    def close_segment(self):
+        if self.file is not None:
+            self.file.close()
+        self.segment, self.file = None, None
+
+    def close(self):
+        self.close_segment()
+        self.index.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+
+def read_blocks(directory: str, segment: str, blocks: List[Dict]) -> pd.DataFrame:
+    """Reads `blocks` of one segment (and nothing else of it)."""
+    path = os.path.join(directory, segment)
+    if segment.endswith(EXTENSIONS["binary"]):
+        with TraceReader(path, index=False) as reader:
+            reader.groups = [
+                {"offset": block["offset"], "num_rows": block["rows"]}
+                for block in blocks
+            ]
+            return reader.to_dataframe().copy()
+    parts = []
+    with open(path, "rb") as f:
+        header = f.readline()
+        # * Adjacent blocks are read at once.
+        begin = end = None
+        for block in blocks + [None]:
+            if block is not None and block["offset"] == end:
+                end += block["length"]
+                continue
+            if begin is not None:
+                f.seek(begin)
+                parts.append(f.read(end - begin))
+            if block is not None:
+                begin, end = block["offset"], block["offset"] + block["length"]
+    return pd.read_csv(io.BytesIO(header + b"".join(parts)))
+
+
+def query(
+    directory: str,
+    t0: float = -np.inf,
+    t1: float = np.inf,
+    tenant: int = None,
+    columns: List[str] = None,
+) -> pd.DataFrame:
+    """Reads the records of segmented traces in [t0, t1], visiting only the blocks
+    of that range (and, if `tenant` is given, of the blocks it was traced in).
+
+    :param columns: Columns to return (all by default).
+    """
+    blocks = [
+        block
+        for block in load_index(directory)
+        if block["time"][1] >= t0
+        and block["time"][0] <= t1
+        and (tenant is None or tenant in block["tenants"])
+    ]
+    frames = []
+    for segment in dict.fromkeys(block["segment"] for block in blocks):
+        frames.append(
+            read_blocks(
+                directory, segment, [b for b in blocks if b["segment"] == segment]
+            )
+        )
+    if not frames:
+        return pd.DataFrame(columns=columns)
+    df = pd.concat(frames, ignore_index=True)
+    df = df[(df["time"] >= t0) & (df["time"] <= t1)].reset_index(drop=True)
+    return df[columns] if columns is not None else df
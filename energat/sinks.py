@@ -0,0 +1,247 @@
+import json
+import os
+import socket
+import sys
+from typing import *
+
+import numpy as np
+import pandas as pd
+
+from energat.common import logger
+from energat.segments import SegmentWriter
+from energat.traceio import TraceWriter
+from energat.writer import AsyncWriter
+
+
+class Batch(NamedTuple):
+    """Records handed to all sinks at once (which must not modify them)."""
+
+    records: Tuple[Dict[str, Any], ...]
+    # * TGIDs of the targets traced in the records.
+    tenants: FrozenSet[int]
+
+
+class Sink(object):
+    """Consumer of the trace records, written on its own thread.
+
+    :attr batch_size: Records worth batching before a write (1 for live sinks).
+    """
+
+    name = "sink"
+    batch_size = 1
+
+    def write(self, batch: Batch):
+        raise NotImplementedError
+
+    def close(self):
+        pass
+
+
+class CsvSink(Sink):
+    """Appends records to a CSV file (without reading it back)."""
+
+    name = "csv"
+    batch_size = 100
+
+    def __init__(self, path: str):
+        self.path = path
+
+    def write(self, batch: Batch):
+        pd.DataFrame(list(batch.records)).to_csv(
+            self.path, mode="a", header=not os.path.isfile(self.path), index=False
+        )
+        logger.info(f"Energy traces saved to {self.path}")
+
+
+class BinarySink(Sink):
+    """Appends every batch as a row group of a binary trace (`energat.traceio`)."""
+
+    name = "binary"
+
+    def __init__(self, path: str, fsync_sec: float = 0.0, fsync_bytes: int = 0):
+        self.writer = TraceWriter(path, fsync_sec, fsync_bytes)
+
+    def write(self, batch: Batch):
+        self.writer.append(list(batch.records))
+
+    def close(self):
+        self.writer.close()
+
+
+class SegmentSink(Sink):
+    """Appends records to time-partitioned segments (`energat.segments`)."""
+
+    name = "segments"
+
+    def __init__(self, directory: str, segment_sec: float, fmt: str, **kwargs):
+        self.writer = SegmentWriter(directory, segment_sec, fmt, **kwargs)
+        self.batch_size = 100 if fmt == "csv" else 1
+
+    def write(self, batch: Batch):
+        self.writer.append(list(batch.records), batch.tenants)
+        logger.info(f"Energy traces saved to {self.writer.directory}")
+
+    def close(self):
+        self.writer.close()
+
+
+def to_ndjson(records: Iterable[Dict[str, Any]]) -> bytes:
+    """:return: {bytes} One JSON object per line (NumPy scalars as numbers)."""
+    default = lambda value: value.item() if isinstance(value, np.generic) else value
+    return b"".join(
+        json.dumps(record, default=default).encode() + b"\n" for record in records
+    )
+
+
+class NdjsonSink(Sink):
+    """Appends records as JSON lines to a file (or a pipe)."""
+
+    name = "ndjson"
+
+    def __init__(self, path: str):
+        self.file = open(path, "ab")
+
+    def write(self, batch: Batch):
+        self.file.write(to_ndjson(batch.records))
+        self.file.flush()
+
+    def close(self):
+        self.file.close()
+
+
+class StdoutSink(NdjsonSink):
+    """Writes records as JSON lines to the standard output (logs go to stderr)."""
+
+    name = "stdout"
+
+    def __init__(self):
+        self.file = sys.stdout.buffer
+
+    def close(self):
+        self.file.flush()
+
+
+class SocketSink(Sink):
+    """Streams records as JSON lines to a TCP or Unix socket.
+
+    Batches are dropped while the peer is unreachable, and the connection is
+    retried on the next one.
+
+    :param address: (host, port) for TCP, or a path for a Unix socket.
+    """
+
+    name = "socket"
+
+    def __init__(self, address: Union[Tuple[str, int], str]):
+        self.address = address
+        self.name = (
+            f"unix:{address}" if isinstance(address, str) else "tcp:%s:%d" % address
+        )
+        self.sock: socket.socket = None
+        self.dropped = 0
+
+    def connect(self) -> socket.socket:
+        if isinstance(self.address, str):
+            sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            sock.connect(self.address)
+            return sock
+        return socket.create_connection(self.address, timeout=1.0)
+
+    def write(self, batch: Batch):
+        try:
+            if self.sock is None:
+                self.sock = self.connect()
+            self.sock.sendall(to_ndjson(batch.records))
+        except OSError as e:
+            if self.dropped == 0:
+                logger.warn(f"Failed to send traces to {self.address}: {e!r}")
+            self.dropped += 1
+            self.close()
+
+    def close(self):
+        if self.sock is not None:
+            self.sock.close()
+            self.sock = None
+
+
+def parse_sink(spec: str, trace_base: str, **kwargs) -> Sink:
+    """Creates a sink from its flag value.
+
+    :param spec: csv, binary, ndjson (files next to the traces), stdout,
+        tcp:HOST:PORT or unix:PATH.
+    :param kwargs: fsync policy of binary traces.
+    """
+    kind, _, address = spec.partition(":")
+    if kind == "csv":
+        return CsvSink(trace_base + ".csv")
+    elif kind == "binary":
+        return BinarySink(trace_base + ".etr", **kwargs)
+    elif kind == "ndjson":
+        return NdjsonSink(trace_base + ".ndjson")
+    elif kind == "stdout":
+        return StdoutSink()
+    elif kind == "tcp":
+        host, _, port = address.rpartition(":")
+        return SocketSink((host, int(port)))
+    elif kind == "unix":
+        return SocketSink(address)
+    raise ValueError(f"Unknown trace sink: {spec}")
+
+
+class SinkPipeline(object):
+    """Fans records out to several sinks.
+
+    Every sink formats and writes on the thread of its own `AsyncWriter` (with
+    its own backpressure policy), so a slow sink holds up neither the others nor
+    the attribution loop. Records are collected per sink until its `batch_size`
+    is reached, so live sinks get every submission while file sinks still get
+    large batches. Sinks with the same pending records share the same immutable
+    batch.
+    """
+
+    def __init__(self, sinks: List[Sink], **kwargs):
+        assert sinks, "No trace sinks"
+        self.sinks = sinks
+        self.writers = [
+            AsyncWriter({sink.name: sink.write}, **kwargs) for sink in sinks
+        ]
+        # * Records (and their tenants) not handed to each sink yet.
+        self.pending: List[List[Dict[str, Any]]] = [[] for _ in sinks]
+        self.pending_tenants: List[Set[int]] = [set() for _ in sinks]
+
+    def submit(
+        self, records: List[Dict[str, Any]], tenants: Iterable[int] = (), force=False
+    ):
+        """Adds records, and hands each sink its pending ones once it has
+        `batch_size` of them (or if forced)."""
+        tenants = set(tenants)
+        batches: Dict[Tuple[int, int], Batch] = {}
+        for i, (sink, writer) in enumerate(zip(self.sinks, self.writers)):
+            self.pending[i] += records
+            self.pending_tenants[i] |= tenants
+            if not self.pending[i] or (
+                not force and len(self.pending[i]) < sink.batch_size
+            ):
+                continue
+            # * Sinks whose pending records are the same share a batch.
+            key = (id(self.pending[i][0]), len(self.pending[i]))
+            if key not in batches:
+                batches[key] = Batch(
+                    tuple(self.pending[i]), frozenset(self.pending_tenants[i])
+                )
+            writer.submit(sink.name, batches[key])
+            self.pending[i], self.pending_tenants[i] = [], set()
+
+    def close(self):
+        """Writes out all records, then closes the sinks."""
+        self.submit([], force=True)
+        for writer in self.writers:
+            writer.close()
+        for sink in self.sinks:
+            sink.close()
+
+    def metrics(self) -> Dict[str, Dict[str, float]]:
+        return {
+            sink.name: writer.metrics()
+            for sink, writer in zip(self.sinks, self.writers)
+        }
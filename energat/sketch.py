@@ -0,0 +1,146 @@
+import math
+from typing import *
+
+import numpy as np
+import numpy.typing as npt
+
+
+def top_k(keys: np.ndarray, weights: np.ndarray, k: int) -> np.ndarray:
+    """:return: {np.ndarray} Indices of the (up to) `k` largest positive weights,
+    heaviest first."""
+    if k <= 0:
+        return np.empty(0, dtype=np.int64)
+    candidates = np.flatnonzero(weights > 0)
+    if candidates.size > k:
+        candidates = candidates[np.argpartition(-weights[candidates], k - 1)[:k]]
+    return candidates[np.argsort(-weights[candidates], kind="stable")]
+
+
+class SpaceSaving(object):
+    """Weighted space-saving sketch of the heaviest keys in bounded memory.
+
+    At most `capacity` counters are kept (sorted by key). Updates come in batches:
+    keys already counted are incremented, and new keys take over the smallest
+    counters, inheriting their count as error. So `count` over-estimates the
+    true weight of a key, and `count - error` under-estimates it.
+    """
+
+    def __init__(self, capacity: int):
+        assert capacity > 0, f"{capacity=}"
+        self.capacity = capacity
+        self.keys = np.empty(0, dtype=np.int64)
+        self.counts = np.empty(0)
+        self.errors = np.empty(0)
+        self.labels = np.empty(0, dtype=object)
+        # * Total weight seen.
+        self.total = 0.0
+
+    def __len__(self):
+        return self.keys.size
+
+    def update(
+        self, keys: npt.ArrayLike, weights: npt.ArrayLike, labels: npt.ArrayLike = None
+    ):
+        keys = np.asarray(keys, dtype=np.int64)
+        weights = np.asarray(weights, dtype=np.float64)
+        labels = np.asarray(
+            labels if labels is not None else [""] * keys.size, dtype=object
+        )
+        keys, first, inverse = np.unique(keys, return_index=True, return_inverse=True)
+        weights = np.bincount(inverse, weights, minlength=keys.size)
+        positive = weights > 0
+        keys, weights, labels = (
+            keys[positive],
+            weights[positive],
+            labels[first][positive],
+        )
+        if keys.size == 0:
+            return
+        self.total += weights.sum()
+
+        """Incrementing counted keys."""
+        pos = np.searchsorted(self.keys, keys)
+        counted = pos < self.keys.size
+        counted[counted] = self.keys[pos[counted]] == keys[counted]
+        self.counts[pos[counted]] += weights[counted]
+        self.labels[pos[counted]] = labels[counted]
+
+        """Adding new keys on top of the smallest counter (if full)."""
+        new = ~counted
+        floor = self.counts.min() if self.keys.size >= self.capacity else 0.0
+        keys = np.concatenate([self.keys, keys[new]])
+        counts = np.concatenate([self.counts, floor + weights[new]])
+        errors = np.concatenate([self.errors, np.full(new.sum(), floor)])
+        labels = np.concatenate([self.labels, labels[new]])
+        if keys.size > self.capacity:
+            keep = np.argpartition(-counts, self.capacity - 1)[: self.capacity]
+            keys, counts, errors, labels = (
+                keys[keep],
+                counts[keep],
+                errors[keep],
+                labels[keep],
+            )
+        order = np.argsort(keys)
+        self.keys, self.counts, self.errors, self.labels = (
+            keys[order],
+            counts[order],
+            errors[order],
+            labels[order],
+        )
+
+    def top(self, k: int) -> List[Tuple[int, str, float, float]]:
+        """:return: {List} Up to `k` (key, label, count, error), heaviest first."""
+        return [
+            (int(self.keys[i]), self.labels[i], self.counts[i], self.errors[i])
+            for i in top_k(self.keys, self.counts, k)
+        ]
+
+
+class QuantileSketch(object):
+    """Mergeable quantile sketch with relative accuracy `alpha` (as DDSketch).
+
+    Positive values are counted in logarithmic buckets ((gamma^(k-1), gamma^k]
+    with gamma = (1 + alpha) / (1 - alpha)), so any quantile is estimated within
+    a factor of 1 +/- alpha, and sketches merge by adding their buckets. Other
+    values are counted as zeros.
+    """
+
+    def __init__(self, alpha: float = 0.01):
+        self.alpha = alpha
+        self.log_gamma = math.log((1 + alpha) / (1 - alpha))
+        self.buckets: Dict[int, int] = {}
+        self.zeros = 0
+        self.count = 0
+
+    def add(self, values: npt.ArrayLike):
+        values = np.atleast_1d(np.asarray(values, dtype=np.float64))
+        positive = values[values > 0]
+        keys, counts = np.unique(
+            np.ceil(np.log(positive) / self.log_gamma).astype(np.int64),
+            return_counts=True,
+        )
+        for key, count in zip(keys.tolist(), counts.tolist()):
+            self.buckets[key] = self.buckets.get(key, 0) + count
+        self.zeros += values.size - positive.size
+        self.count += values.size
+
+    def merge(self, other: "QuantileSketch"):
+        for key, count in other.buckets.items():
+            self.buckets[key] = self.buckets.get(key, 0) + count
+        self.zeros += other.zeros
+        self.count += other.count
+
+    def quantile(self, q: float) -> float:
+        """:return: {float} Estimate of the `q`-quantile (NaN if empty)."""
+        if self.count == 0:
+            return np.nan
+        rank = q * (self.count - 1)
+        if rank < self.zeros:
+            return 0.0
+        seen = self.zeros
+        for key in sorted(self.buckets):
+            seen += self.buckets[key]
+            if seen > rank:
+                break
+        # * Midpoint (in relative terms) of the bucket.
+        return 2 * math.exp(key * self.log_gamma) / (1 + math.exp(self.log_gamma))
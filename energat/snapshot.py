@@ -0,0 +1,78 @@
+import time
+from typing import *
+
+
+class Snapshot(object):
+    """Inputs of one interval, each stamped with the time window it was read in.
+
+    Every source is read through `capture()`. The midpoint of its read window
+    stands for the instant of the reading, so the window a delta covers is the
+    distance between the midpoints of two consecutive snapshots. Deltas of
+    different sources cover different windows when their endpoints are
+    misaligned, which is what matters when they are combined (a constant offset
+    between two sources does not change their deltas).
+    """
+
+    def __init__(self, clock=time.perf_counter):
+        self.clock = clock
+        self.values: Dict[str, Any] = {}
+        # * Source -> (begin, end) of the read.
+        self.stamps: Dict[str, Tuple[float, float]] = {}
+
+    def capture(self, source: str, read: Callable[..., Any], *args, **kwargs):
+        """Reads a source and stamps it.
+
+        :return: The value returned by `read`.
+        """
+        begin = self.clock()
+        value = read(*args, **kwargs)
+        end = self.clock()
+        self.values[source] = value
+        self.stamps[source] = (begin, end)
+        return value
+
+    def __getitem__(self, source: str):
+        return self.values[source]
+
+    def time_of(self, source: str) -> float:
+        begin, end = self.stamps[source]
+        return (begin + end) / 2
+
+    @property
+    def span(self) -> float:
+        """Seconds from the first read begun to the last read finished."""
+        begins, ends = zip(*self.stamps.values())
+        return max(ends) - min(begins)
+
+    def window(self, previous: "Snapshot", source: str) -> float:
+        """:return: {float} Seconds covered by the delta of `source` since `previous`."""
+        return self.time_of(source) - previous.time_of(source)
+
+    def common_sources(
+        self, previous: "Snapshot", sources: Iterable[str] = None
+    ) -> List[str]:
+        """:return: {List[str]} `sources` (all by default) read in both snapshots."""
+        sources = self.stamps if sources is None else sources
+        return [s for s in sources if s in self.stamps and s in previous.stamps]
+
+    def misalignment(
+        self, previous: "Snapshot", reference: str, sources: Iterable[str] = None
+    ) -> Dict[str, float]:
+        """:return: {Dict[str, float]} Source -> seconds by which its window since
+        `previous` is longer (or shorter, if negative) than that of `reference`."""
+        ref = self.window(previous, reference)
+        return {
+            source: self.window(previous, source) - ref
+            for source in self.common_sources(previous, sources)
+        }
+
+    def scales(
+        self, previous: "Snapshot", reference: str, sources: Iterable[str] = None
+    ) -> Dict[str, float]:
+        """:return: {Dict[str, float]} Source -> factor bringing its delta since
+        `previous` to the window of `reference`."""
+        ref = self.window(previous, reference)
+        return {
+            source: ref / self.window(previous, source)
+            for source in self.common_sources(previous, sources)
+        }
@@ -0,0 +1,218 @@
+import glob
+import json
+import os
+import struct
+import zlib
+from typing import *
+
+import numpy as np
+import pandas as pd
+
+try:
+    import zstandard
+except ImportError:
+    zstandard = None
+
+# * Command names are truncated like the kernel's (TASK_COMM_LEN without the NUL),
+# * as psutil may report longer ones (e.g., from the cmdline).
+COMM_DTYPE = "U15"
+
+"""Columns (and types) of the per-task breakdown."""
+TASK_COLUMNS = {
+    "time": np.float64,
+    "tid": np.int64,
+    "tgid": np.int64,
+    "comm": COMM_DTYPE,
+    "socket": np.int16,
+    "cpu_joules": np.float64,
+    "dram_joules": np.float64,
+}
+"""Columns (and types) of the per-process roll-ups."""
+PROCESS_COLUMNS = {
+    "time": np.float64,
+    "tgid": np.int64,
+    "comm": COMM_DTYPE,
+    "socket": np.int16,
+    "num_threads": np.int32,
+    "cpu_joules": np.float64,
+    "dram_joules": np.float64,
+}
+
+"""Streaming format (`<dir>/tasks.etz`): a sequence of independently compressed
+frames, each holding one flushed batch of tasks and processes."""
+STREAM_FILE = "tasks.etz"
+FRAME_HEADER = struct.Struct("<4sB3xII")
+FRAME_MAGIC = b"ETZ1"
+CODEC_ZLIB, CODEC_ZSTD = 1, 2
+
+
+def narrowest_uint(n: int) -> np.dtype:
+    return np.dtype(np.uint8 if n <= 2**8 else np.uint16 if n <= 2**16 else np.uint32)
+
+
+def encode_columns(columns: Dict[str, np.ndarray]) -> bytes:
+    """Encodes a batch of columns for compression.
+
+    Strings, integers and low-cardinality floats (e.g., timestamps) are
+    dictionary-encoded: sorted distinct values plus narrow codes. Distinct
+    integers are stored as deltas (small and repetitive after sorting).
+    """
+    specs, arrays = [], []
+    for name, array in columns.items():
+        spec = {"name": name, "dtype": array.dtype.str, "n": array.size}
+        values, codes = np.unique(array, return_inverse=True)
+        if array.dtype.kind in "iuU" or values.size <= array.size // 4:
+            spec["values"] = values.size
+            spec["codes"] = narrowest_uint(values.size).str
+            if array.dtype.kind == "U":
+                values = np.frombuffer("\0".join(values.tolist()).encode(), np.uint8)
+                spec["nbytes"] = values.size
+            elif array.dtype.kind in "iu":
+                values = np.diff(values.astype(np.int64), prepend=0)
+            arrays += [values, codes.astype(spec["codes"])]
+        else:
+            arrays.append(array)
+        specs.append(spec)
+    header = json.dumps(specs).encode()
+    return b"".join(
+        [struct.pack("<I", len(header)), header] + [a.tobytes() for a in arrays]
+    )
+
+
+def decode_columns(data: bytes) -> Dict[str, np.ndarray]:
+    (header_len,) = struct.unpack_from("<I", data)
+    offset = 4 + header_len
+    columns = {}
+
+    def take(dtype, count):
+        nonlocal offset
+        array = np.frombuffer(data, dtype, count, offset)
+        offset += array.nbytes
+        return array
+
+    for spec in json.loads(data[4:offset]):
+        dtype = np.dtype(spec["dtype"])
+        if "values" not in spec:
+            columns[spec["name"]] = take(dtype, spec["n"])
+            continue
+        if dtype.kind == "U":
+            text = take(np.uint8, spec["nbytes"]).tobytes().decode()
+            values = np.array(text.split("\0") if spec["values"] else [], dtype)
+        elif dtype.kind in "iu":
+            values = np.cumsum(take(np.int64, spec["values"])).astype(dtype)
+        else:
+            values = take(dtype, spec["values"])
+        columns[spec["name"]] = values[take(spec["codes"], spec["n"])]
+    return columns
+
+
+def compress_frame(raw: bytes) -> bytes:
+    """Compresses with zstd if available (zlib otherwise, level 1 to keep up)."""
+    if zstandard is not None:
+        codec, data = CODEC_ZSTD, zstandard.ZstdCompressor(level=3).compress(raw)
+    else:
+        codec, data = CODEC_ZLIB, zlib.compress(raw, 1)
+    return FRAME_HEADER.pack(FRAME_MAGIC, codec, len(raw), len(data)) + data
+
+
+def iter_frames(path: str) -> Iterator[Dict[str, np.ndarray]]:
+    """Decodes the frames of a stream in one pass (stopping at a torn frame)."""
+    with open(path, "rb") as f:
+        while True:
+            header = f.read(FRAME_HEADER.size)
+            if len(header) < FRAME_HEADER.size:
+                return
+            magic, codec, raw_size, size = FRAME_HEADER.unpack(header)
+            data = f.read(size)
+            if magic != FRAME_MAGIC or len(data) < size:
+                return
+            if codec == CODEC_ZSTD:
+                if zstandard is None:
+                    raise RuntimeError(f"{path} needs `zstandard` to be decoded")
+                raw = zstandard.ZstdDecompressor().decompress(data, raw_size)
+            else:
+                raw = zlib.decompress(data)
+            yield decode_columns(raw)
+
+
+class TaskTraceBuffer(object):
+    """Accumulates per-interval column batches of tasks and processes.
+
+    Each flush is written as one compressed chunk of typed columns
+    (`<dir>/<seq>.npz`), or as one frame appended to a stream (`<dir>/tasks.etz`,
+    see `encode_columns()`) if `stream`, so appending never rewrites earlier
+    chunks.
+    """
+
+    def __init__(self, directory: str, stream=False):
+        self.directory = directory
+        self.stream = stream
+        self.tasks: List[Dict[str, np.ndarray]] = []
+        self.processes: List[Dict[str, np.ndarray]] = []
+        self.num_rows = 0
+        os.makedirs(directory, exist_ok=True)
+        self.seq = len(glob.glob(f"{directory}/*.npz"))
+
+    def append(self, tasks: Dict[str, np.ndarray], processes: Dict[str, np.ndarray]):
+        self.tasks.append(tasks)
+        self.processes.append(processes)
+        self.num_rows += tasks["tid"].size
+
+    def take(self) -> Tuple[Dict[str, np.ndarray], Dict[str, np.ndarray]]:
+        """Concatenates and clears the buffered batches."""
+
+        def concat(batches, columns):
+            return {
+                column: np.concatenate(
+                    [batch[column] for batch in batches] or [np.empty(0, dtype=dtype)]
+                ).astype(dtype)
+                for column, dtype in columns.items()
+            }
+
+        tasks = concat(self.tasks, TASK_COLUMNS)
+        processes = concat(self.processes, PROCESS_COLUMNS)
+        self.tasks, self.processes, self.num_rows = [], [], 0
+        return tasks, processes
+
+    def write(self, tasks: Dict[str, np.ndarray], processes: Dict[str, np.ndarray]):
+        """Writes one chunk (call with the output of `take()`)."""
+        columns = {
+            **{f"task_{column}": array for column, array in tasks.items()},
+            **{f"proc_{column}": array for column, array in processes.items()},
+        }
+        if self.stream:
+            path = f"{self.directory}/{STREAM_FILE}"
+            with open(path, "ab") as f:
+                f.write(compress_frame(encode_columns(columns)))
+            return path
+        path = f"{self.directory}/{self.seq:06d}.npz"
+        self.seq += 1
+        np.savez_compressed(path, **columns)
+        return path
+
+
+def load_task_traces(directory: str) -> Tuple[pd.DataFrame, pd.DataFrame]:
+    """Loads all chunks of a per-task breakdown.
+
+    :return: {Tuple[pd.DataFrame, pd.DataFrame]} (per-task rows, per-process rows)
+    """
+    tasks, processes = [], []
+
+    def append(chunk):
+        tasks.append(pd.DataFrame({c: chunk[f"task_{c}"] for c in TASK_COLUMNS}))
+        processes.append(pd.DataFrame({c: chunk[f"proc_{c}"] for c in PROCESS_COLUMNS}))
+
+    for path in sorted(glob.glob(f"{directory}/*.npz")):
+        with np.load(path) as chunk:
+            append(chunk)
+    if os.path.isfile(f"{directory}/{STREAM_FILE}"):
+        for chunk in iter_frames(f"{directory}/{STREAM_FILE}"):
+            append(chunk)
+    if not tasks:
+        return pd.DataFrame(columns=list(TASK_COLUMNS)), pd.DataFrame(
+            columns=list(PROCESS_COLUMNS)
+        )
+    return (
+        pd.concat(tasks, ignore_index=True),
+        pd.concat(processes, ignore_index=True),
+    )
@@ -0,0 +1,317 @@
+import json
+import mmap
+import os
+import struct
+import time
+import zlib
+from typing import *
+
+import numpy as np
+import pandas as pd
+
+"""Binary trace file layout (little-endian):
+
+    MAGIC | SCHM frame | ROWS frame | ROWS frame | ... [| INDX frame | trailer]
+
+Every frame is a header (tag, CRC32 of the body, meta and payload lengths)
+followed by a JSON meta block and a payload, both padded to 8 bytes. A ROWS
+frame (row group) holds the columns of a batch of records back to back, each
+starting at an 8-byte aligned offset. Numeric columns are raw arrays; string
+columns are [num_rows + 1] int64 offsets followed by the UTF-8 bytes.
+
+Frames are only ever appended. The INDX frame (offsets, sizes and time ranges of
+all row groups) and the trailer pointing at it are written on close and dropped
+by the next writer. Without them (e.g., after a crash), readers scan the frames
+and stop at the first one that is torn or fails its checksum.
+"""
+MAGIC = b"ENERGAT\x02"
+FRAME = struct.Struct("<4sIIQ4x")
+TRAILER = struct.Struct("<Q8s")
+TRAILER_MAGIC = b"ETRINDEX"
+ALIGN = 8
+STR = "str"
+
+
+def pad(data: bytes) -> bytes:
+    return data + b"\0" * (-len(data) % ALIGN)
+
+
+def infer_schema(records: List[Dict[str, Any]]) -> Dict[str, str]:
+    """:return: {Dict[str, str]} Column -> type ("<f8", "<i8" or "str")."""
+    schema = {}
+    for column in records[0]:
+        kind = np.asarray([record[column] for record in records]).dtype.kind
+        schema[column] = "<f8" if kind == "f" else "<i8" if kind in "iub" else STR
+    return schema
+
+
+def encode_column(values: List[Any], dtype: str) -> bytes:
+    if dtype != STR:
+        return np.asarray(values, dtype=dtype).tobytes()
+    encoded = [str(value).encode() for value in values]
+    offsets = np.zeros(len(encoded) + 1, dtype="<i8")
+    np.cumsum([len(value) for value in encoded], out=offsets[1:])
+    return offsets.tobytes() + b"".join(encoded)
+
+
+def encode_frame(tag: bytes, meta: Dict[str, Any], payload: bytes = b"") -> bytes:
+    meta = pad(json.dumps(meta).encode())
+    payload = pad(payload)
+    crc = zlib.crc32(payload, zlib.crc32(meta))
+    return FRAME.pack(tag, crc, len(meta), len(payload)) + meta + payload
+
+
+class TraceWriter(object):
+    """Appends batches of records to a binary trace file as checksummed frames.
+
+    Reopening a file drops its index and anything after the last valid frame,
+    so the writer carries on from the last complete batch. Every frame is handed
+    to the OS as soon as it is written (so it survives the tracer being killed),
+    and `fsync()`-ed once `fsync_sec` seconds or `fsync_bytes` bytes have passed
+    since the last one (checked on append; never if both are 0). All batches
+    must have the columns (and types) of the first one.
+    """
+
+    def __init__(self, path: str, fsync_sec: float = 0.0, fsync_bytes: int = 0):
+        self.path = path
+        self.fsync_sec = fsync_sec
+        self.fsync_bytes = fsync_bytes
+        self.schema: Dict[str, str] = None
+        # * Row groups as {"offset" (of the frame), "num_rows", "time" range}.
+        self.groups: List[Dict[str, Any]] = []
+        self.last_sync = time.monotonic()
+        self.unsynced_bytes = 0
+        if os.path.isfile(path) and os.path.getsize(path) >= len(MAGIC):
+            with TraceReader(path) as reader:
+                self.schema, self.groups = reader.schema, reader.groups
+                self.end = reader.data_end
+            self.file = open(path, "r+b")
+            self.file.truncate(self.end)
+            self.file.seek(self.end)
+        else:
+            self.file = open(path, "w+b")
+            self.end = self.write(MAGIC)
+
+    def write(self, data: bytes) -> int:
+        self.file.write(data)
+        self.file.flush()
+        self.unsynced_bytes += len(data)
+        return len(data)
+
+    def append(self, records: List[Dict[str, Any]]):
+        if not records:
+            return
+        if self.schema is None:
+            self.schema = infer_schema(records)
+            self.end += self.write(
+                encode_frame(b"SCHM", {"schema": list(self.schema.items())})
+            )
+        elif list(records[0]) != list(self.schema):
+            raise ValueError(f"Columns {list(records[0])} != {list(self.schema)}")
+
+        payload, columns = [], {}
+        offset = 0
+        for column, dtype in self.schema.items():
+            data = pad(encode_column([record[column] for record in records], dtype))
+            payload.append(data)
+            columns[column] = [offset, len(data)]
+            offset += len(data)
+        times = [record["time"] for record in records] if "time" in self.schema else []
+        group = {
+            "offset": self.end,
+            "num_rows": len(records),
+            "time": [min(times), max(times)] if times else None,
+        }
+        self.end += self.write(
+            encode_frame(b"ROWS", {**group, "columns": columns}, b"".join(payload))
+        )
+        self.groups.append(group)
+        self.sync()
+
+    def truncate(self, end: int):
+        """Drops the row groups from `end` on (the end of a frame)."""
+        self.groups = [group for group in self.groups if group["offset"] < end]
+        self.file.truncate(end)
+        self.file.seek(end)
+        self.end = end
+
+    def sync(self, force=False):
+        """`fsync()`s the file if due by the policy (or if forced)."""
+        due = force or 0 < self.fsync_bytes <= self.unsynced_bytes
+        due |= 0 < self.fsync_sec <= time.monotonic() - self.last_sync
+        if due and self.unsynced_bytes > 0:
+            os.fsync(self.file.fileno())
+            self.last_sync = time.monotonic()
+            self.unsynced_bytes = 0
+
+    def close(self):
+        """Writes the index of all row groups and closes the file."""
+        index = encode_frame(b"INDX", {"groups": self.groups})
+        self.write(index + TRAILER.pack(self.end, TRAILER_MAGIC))
+        self.sync(force=self.fsync_sec > 0 or self.fsync_bytes > 0)
+        self.file.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+
+class TraceReader(object):
+    """Reads a binary trace file through a read-only memory map.
+
+    Numeric columns of a row group are returned as NumPy views of the mapping
+    (no copy, no parsing), so they are only valid while the reader is open.
+
+    :param index: If the row groups are loaded (from the index, or by scanning
+        the file); otherwise only the schema is, and callers that know where
+        row groups are (e.g., `energat.segments`) fill `groups` themselves.
+    """
+
+    def __init__(self, path: str, index=True):
+        self.path = path
+        with open(path, "rb") as f:
+            self.mm = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        if self.mm[: len(MAGIC)] != MAGIC:
+            raise ValueError(f"{path} is not an energat trace")
+        self.schema: Dict[str, str] = None
+        self.groups: List[Dict[str, Any]] = []
+        # * End of the last valid frame (where the next one is appended).
+        self.data_end = len(MAGIC)
+        # * Whether the index was missing (e.g., after a crash).
+        self.recovered = False
+        # * Row group -> column -> (offset, nbytes) in the file.
+        self.layouts: Dict[int, Dict[str, Tuple[int, int]]] = {}
+        if not index:
+            self.data_end = len(self.mm)
+            self.read_schema()
+        elif not self.read_index():
+            self.recovered = True
+            self.scan()
+
+    def read_frame(self, offset: int, end: int) -> Optional[Tuple]:
+        """:return: {Tuple} (tag, meta, payload offset, end of the frame), or None
+        if the frame is torn or corrupted."""
+        if offset + FRAME.size > end:
+            return None
+        tag, crc, meta_len, payload_len = FRAME.unpack_from(self.mm, offset)
+        body = offset + FRAME.size
+        frame_end = body + meta_len + payload_len
+        if frame_end > end or zlib.crc32(self.mm[body:frame_end]) != crc:
+            return None
+        meta = json.loads(self.mm[body : body + meta_len].rstrip(b"\0"))
+        return tag, meta, body + meta_len, frame_end
+
+    def read_index(self) -> bool:
+        """Loads the row groups from the index (without visiting them)."""
+        if len(self.mm) < len(MAGIC) + TRAILER.size:
+            return False
+        end, magic = TRAILER.unpack_from(self.mm, len(self.mm) - TRAILER.size)
+        if magic != TRAILER_MAGIC or end > len(self.mm) - TRAILER.size:
+            return False
+        index = self.read_frame(end, len(self.mm) - TRAILER.size)
+        if index is None or index[0] != b"INDX":
+            return False
+        self.data_end = end
+        self.read_schema()
+        self.groups = index[1]["groups"]
+        return True
+
+    def read_schema(self):
+        schema = self.read_frame(len(MAGIC), self.data_end)
+        if schema is not None and schema[0] == b"SCHM":
+            self.schema = dict(schema[1]["schema"])
+
+    def scan(self):
+        """Loads the row groups by visiting all frames up to the first invalid one."""
+        offset = len(MAGIC)
+        while True:
+            frame = self.read_frame(offset, len(self.mm))
+            if frame is None or frame[0] == b"INDX":
+                break
+            tag, meta, _, frame_end = frame
+            if tag == b"SCHM":
+                self.schema = dict(meta["schema"])
+            elif tag == b"ROWS":
+                self.groups.append(
+                    {key: meta[key] for key in ("offset", "num_rows", "time")}
+                )
+            offset = self.data_end = frame_end
+
+    @property
+    def num_rows(self) -> int:
+        return sum(group["num_rows"] for group in self.groups)
+
+    def layout(self, group: int) -> Dict[str, Tuple[int, int]]:
+        """:return: {Dict} Column -> (offset, nbytes) in row group `group`."""
+        if group not in self.layouts:
+            _, meta, payload, _ = self.read_frame(
+                self.groups[group]["offset"], self.data_end
+            )
+            self.layouts[group] = {
+                column: (payload + offset, nbytes)
+                for column, (offset, nbytes) in meta["columns"].items()
+            }
+        return self.layouts[group]
+
+    def group_column(self, group: int, column: str) -> np.ndarray:
+        """:return: {np.ndarray} Values of `column` in row group `group`."""
+        num_rows = self.groups[group]["num_rows"]
+        offset, nbytes = self.layout(group)[column]
+        dtype = self.schema[column]
+        if dtype != STR:
+            return np.frombuffer(self.mm, dtype=dtype, count=num_rows, offset=offset)
+        offsets = np.frombuffer(self.mm, dtype="<i8", count=num_rows + 1, offset=offset)
+        data = offset + offsets.nbytes
+        return np.array(
+            [
+                self.mm[data + begin : data + end].decode()
+                for begin, end in zip(offsets[:-1].tolist(), offsets[1:].tolist())
+            ],
+            dtype=object,
+        )
+
+    def column(self, column: str, groups: Iterable[int] = None) -> np.ndarray:
+        """:return: {np.ndarray} Values of `column` in `groups` (all by default),
+        as a view if only one row group is read."""
+        groups = range(len(self.groups)) if groups is None else list(groups)
+        parts = [self.group_column(group, column) for group in groups]
+        if len(parts) == 1:
+            return parts[0]
+        if not parts:
+            return np.empty(
+                0, dtype=object if self.schema[column] == STR else self.schema[column]
+            )
+        return np.concatenate(parts)
+
+    def to_dataframe(self, groups: Iterable[int] = None) -> pd.DataFrame:
+        """:return: {pd.DataFrame} Row groups `groups` (all by default), wrapping
+        numeric columns of a single row group without copy."""
+        groups = None if groups is None else list(groups)
+        return pd.DataFrame(
+            {column: self.column(column, groups) for column in self.schema or {}},
+            copy=False,
+        )
+
+    def close(self):
+        self.mm.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+
+def load_traces(path: str) -> pd.DataFrame:
+    """Loads energy traces written in any of the trace formats."""
+    if os.path.isdir(path):
+        from energat.segments import query
+
+        return query(path)
+    if path.endswith(".csv"):
+        return pd.read_csv(path)
+    with TraceReader(path) as reader:
+        # * Copy out of the mapping before it is closed.
+        return reader.to_dataframe().copy()
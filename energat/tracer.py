@@ -3,7 +3,7 @@ import json
 import multiprocessing
 import os
 import subprocess
-import threading
+import sys
 import time
 from functools import cache
 from typing import *
@@ -15,6 +15,17 @@ import psutil
 
 from energat.basepower import BaselinePower
 from energat.common import *
+from energat.kernel import AttributionKernel, credit_fracs, power_law_energy
+from energat.perf import CgroupCounters, ImcCounters, ThreadCounters
+from energat.rollup import Rollups
+from energat.ring import TraceRing
+from energat.procfs import FIELD_INDEX, CpuPlacement, KernelWork, ProcStatReader
+from energat.scheduler import Scheduler
+from energat.sinks import SegmentSink, Sink, SinkPipeline, parse_sink
+from energat.snapshot import Snapshot
+from energat.tasktrace import COMM_DTYPE, TaskTraceBuffer
+from energat.tsdb import TimeSeriesStore
+from energat.writer import AsyncWriter
 from energat.target import TargetStatus
 
 # * Load configurations.
@@ -22,6 +33,10 @@ from energat.target import TargetStatus
 
 
 class EnergyTracer(object):
+    # * Inputs whose deltas are rescaled to the energy window (counter-based
+    # * credits are ratios of counts read together, so they need no rescaling).
+    SCALED_SOURCES = ("targets", "kernel", "server")
+
     def __init__(
         self, target_pid: int, attach=False, project: str = None, output: str = None
     ):
@@ -32,6 +47,7 @@ class EnergyTracer(object):
         self.target_process = psutil.Process(target_pid) if target_pid > 0 else None
         self.core_pkg_map = self.get_core_pkg_mapping()
         self.num_cpu_sockets = len(set(self.core_pkg_map.values()))
+        self.proc_stat = ProcStatReader(self.core_pkg_map)
         # * [[pkg_max1, pkg_max2, ...], [dram_max1, dram_max2, ...]]
         self.max_energy_ranges_j = self.read_max_energy_ranges()
 
@@ -42,25 +58,67 @@ class EnergyTracer(object):
         self.tracer_process = multiprocessing.Process(
             name="EnergAt::tracer", target=self.run, args=[]
         )
-        self.tracer_daemon_thread = None
-        self.mutex = threading.Lock()
-        self.iolock = threading.Lock()
+        # * Periodic tasks of the tracer process (see `run()`).
+        self.scheduler: Scheduler = None
+        # * Slot generation -> sampled task.
+        self.sampled_tasks: Dict[int, psutil.Process] = {}
+        # * Next owner slot whose memory is sampled, and owners earned so far
+        # * (in 1/ticks-per-sweep units) but not sampled yet.
+        self.mem_cursor = 0
+        self.mem_credit = 0
+        self.targets_alive = True
+        # * Opened inside the tracer process (see `open_*_counters()`).
+        self.cgroup_counters: CgroupCounters = None
+        self.thread_counters: ThreadCounters = None
+        self.imc_counters: ImcCounters = None
+        # * Kernel-thread and I/O accounting (if `kernel_credit`).
+        self.kernel_work: KernelWork = None
+        # * Sockets of tasks confined to one socket (if `static_residence`).
+        self.placement = (
+            CpuPlacement(self.core_pkg_map) if FLAGS.static_residence else None
+        )
 
         # * Target ID -> status.
         self.targets_status: Dict[int, "TargetStatus"] = {}
-        # * Socket ID -> list of used mem mib.
-        self.server_numa_mem_samples: Dict[int, List[float]] = {
-            socket: [] for socket in range(self.num_cpu_sockets)
-        }
+        # * Target ID -> thread group ID.
+        self.target_tgids: Dict[int, int] = {}
+        # * Per-task samples and cputimes of all targets.
+        self.kernel = AttributionKernel(
+            self.num_cpu_sockets, max_capacity=FLAGS.max_tasks
+        )
 
         os.makedirs(FLAGS.output, exist_ok=True)
 
         self.traces: List[Dict[str, float]] = []
+        # * TGIDs of the targets traced since the last flush.
+        self.trace_tenants: Set[int] = set()
+        # * Latest traces shared with this process (if `live_rows`), created
+        # * before the tracer process is forked.
+        self.ring = TraceRing(FLAGS.live_rows) if FLAGS.live_rows > 0 else None
+        # * Trace file and `trace_sinks`, each written on its own thread.
+        self.sinks: SinkPipeline = None
+        # * Writes out breakdowns and rollups off the attribution loop.
+        self.writer: AsyncWriter = None
+        # * Recent counters and attributions in memory (if `tsdb_retention`).
+        self.tsdb = (
+            TimeSeriesStore(FLAGS.tsdb_retention) if FLAGS.tsdb_retention > 0 else None
+        )
+        # * 1s/1min/1h aggregates next to the traces (if `rollups`).
+        self.rollups = Rollups(self.emit_rollup) if FLAGS.rollups else None
         project = project if project else str(round(time.time()))
-        self.trace_file = (
-            (FLAGS.output + f"/energat_traces_{project}.csv")
-            if not output
-            else output + ".csv"
+        self.trace_base = (
+            (FLAGS.output + f"/energat_traces_{project}") if not output else output
+        )
+        self.trace_file = self.trace_base + (
+            "_segments"
+            if FLAGS.segment_sec > 0
+            else ".csv" if FLAGS.trace_format == "csv" else ".etr"
+        )
+        # * Per-task and per-process breakdowns (if `task_output`).
+        self.task_traces = (
+            TaskTraceBuffer(self.trace_base + "_tasks", FLAGS.task_format == "stream")
+            if FLAGS.task_output
+            else None
         )
 
         self.baseline = BaselinePower(self.num_cpu_sockets)
@@ -71,348 +129,678 @@ class EnergyTracer(object):
         return
 
     def run(self, rapl_interval_sec=FLAGS.interval):
-        ts_start = time.perf_counter()
+        self.ts_start = time.perf_counter()
         if rapl_interval_sec < 0.05:
             logger.critical(
                 f"RAPL sampling interval ({rapl_interval_sec}s) shouldn't be < 50ms"
             )
 
-        self.tracer_daemon_thread = threading.Thread(
-            name="tracer-daemon", target=self.sample_targets_status, daemon=True
+        writer_policy = dict(
+            policy=FLAGS.writer_policy,
+            max_pending=FLAGS.writer_queue,
+            spill_dir=FLAGS.output,
+        )
+        self.sinks = SinkPipeline(self.open_sinks(), **writer_policy)
+        self.writer = AsyncWriter(
+            {"tasks": self.write_task_traces, "rollups": self.write_rollup},
+            **writer_policy,
         )
-        self.tracer_daemon_thread.start()
-        tasks = [self.tracer_process.pid, self.tracer_daemon_thread.native_id]
         logger.info(f"Tracer process PID: {self.tracer_process.pid}")
-        logger.info(f"Daemon thread TID: {self.tracer_daemon_thread.native_id}")
-        pin_tasks(tasks)
+        pin_tasks([self.tracer_process.pid])
+        self.cgroup_counters = self.open_cgroup_counters()
 
         # * [num_sockets x (pkg, dram)]
         # ! These temporary counters could overflow for long-running experiments
         # ! (but they aren't recorded in the traces).
-        total_consumption = np.array(self.get_empty_energy_readings())
-        baseline_consumption = np.array(self.get_empty_energy_readings())
-        ascribable_consumption = np.array(self.get_empty_energy_readings())
+        self.total_consumption = np.array(self.get_empty_energy_readings())
+        self.baseline_consumption = np.array(self.get_empty_energy_readings())
+        self.ascribable_consumption = np.array(self.get_empty_energy_readings())
+
+        # * Obtain threads and processes before the start, and take the first
+        # * snapshot in the same order as `attribute_interval()`.
+        self.targets_alive = self.update_targets()
+        self.kernel_work = (
+            KernelWork(self.core_pkg_map) if FLAGS.kernel_credit else None
+        )
+        self.snapshot_before = Snapshot()
+        self.snapshot_before.capture("targets", self.sync_targets_status)
+        if self.kernel_work:
+            self.kernel_work.refresh()
+            self.snapshot_before.capture("kernel", self.read_kernel_work)
+        self.snapshot_before.capture("server", self.get_server_cputime_breakdown)
+        self.snapshot_before.capture("rapl", self.read_pkg_mem_joules)
+        # * Tasks whose cputime was read in the last snapshot.
+        self.slots_before = self.kernel.generations()
+        self.imc_counters = self.open_imc_counters()
+        # * Targets found later are attached by `sync_targets_status`.
+        self.thread_counters = self.open_thread_counters()
+
+        """Running all periodic tasks on this (pinned) thread."""
+        # * Phases keep the cheap sampling ticks, the expensive memory sampling
+        # * and the once-per-interval tasks from waking up at the same time.
+        tick = FLAGS.rapl_period
+        self.scheduler = Scheduler()
+        self.scheduler.add(
+            "attribute", rapl_interval_sec, self.attribute_interval, rapl_interval_sec
+        )
+        self.scheduler.add("residence", tick, self.sample_residence)
+        self.scheduler.add("memory", tick, self.sample_memory, phase=tick / 2)
+        if self.tsdb:
+            self.scheduler.add("counters", tick, self.sample_counters, phase=tick / 4)
+        self.scheduler.add(
+            "discover",
+            rapl_interval_sec,
+            self.discover_targets,
+            1.5 * rapl_interval_sec,
+        )
+        self.scheduler.add(
+            "flush", rapl_interval_sec, self.flush_results, 1.75 * rapl_interval_sec
+        )
+        with ProcessSignalHandler() as self.sighandler:
+            self.scheduler.run()
 
-        # * [num_sockets x 1]
-        server_cputime_before = self.get_server_cputime()
-        readings_before = self.read_pkg_mem_joules()
-        ts_before = time.perf_counter()
+        # * Not on stdout, which may carry the traces (`trace_sinks=stdout`).
+        print(file=sys.stderr)
+        logger.warn(f"Tracer was stopped!!!")
+        logger.info(
+            f"Total duration: {datetime.timedelta(seconds=time.perf_counter()-self.ts_start)}"
+        )
+        for socket in range(self.num_cpu_sockets):
+            logger.info(
+                f"Total energy of {socket=} (pkg, dram):"
+                f"\t {self.total_consumption[:, socket]} J"
+            )
+            logger.info(
+                f"Baseline energy of {socket=} (pkg, dram):"
+                f"\t {self.baseline_consumption[:, socket]} J"
+            )
+            logger.info(
+                f"Ascribed energy of {socket=} (pkg, dram):"
+                f"{self.ascribable_consumption[:, socket]} J"
+            )
+        for task in self.scheduler.tasks:
+            logger.info(f"Scheduled {task}")
+        if self.rollups:
+            self.rollups.flush()
+        self.sinks.close()
+        self.writer.close()
+        logger.info(f"Sinks {self.sinks.metrics()}")
+        logger.info(f"Writer {self.writer.metrics()}")
+        if self.tsdb:
+            logger.info(
+                f"Kept {len(self.tsdb.keys())} series in {self.tsdb.nbytes / 2**20:.2f} MiB"
+            )
+        self.proc_stat.close()
+        if self.cgroup_counters:
+            self.cgroup_counters.close()
+        if self.thread_counters:
+            self.thread_counters.close()
+        if self.imc_counters:
+            self.imc_counters.close()
+        return
 
-        # * Obtain threads and processes before the start.
-        self.update_targets()
-        self.empty_targets_status()
+    def attribute_interval(self):
+        """Reads the energy of the past interval and ascribes it to the targets."""
+        """Reading all inputs of the interval back to back."""
+        # * The slow per-target reads come first and RAPL last, so that the
+        # * energy window ends as close as possible to the other readings.
+        before, snapshot = self.snapshot_before, Snapshot()
+        cpu_credit_fracs = (
+            snapshot.capture("cgroup", self.cgroup_counters.read_credit_fracs)[0]
+            if self.cgroup_counters
+            else None
+        )
+        cycle_counts, mem_traffic = snapshot.capture(
+            "counters", self.read_counter_activity
+        )
+        snapshot.capture("targets", self.read_targets_cputime)
+        if self.kernel_work:
+            snapshot.capture("kernel", self.read_kernel_work)
+        snapshot.capture("server", self.get_server_cputime_breakdown)
+        snapshot.capture("rapl", self.read_pkg_mem_joules)
+
+        """Reading energy from RAPL interface."""
+        # * [2 x num_sockets]: Column i is the (cpu, dram) of socket i.
+        total_energy_j = np.array(snapshot["rapl"]) - np.array(before["rapl"])
+        if (total_energy_j < 0).any():
+            overflow_indices = np.where(total_energy_j < 0)
+            total_energy_j[overflow_indices] = +self.max_energy_ranges_j[
+                overflow_indices
+            ]
+            logger.warn(
+                f"Negative energy reading occurred -> Max RAPL ranges exceeded."
+            )
+
+        self.total_consumption += total_energy_j
+        duration_sec = snapshot.window(before, "rapl")
+
+        """Completing the residence and memory samples of the interval."""
+        self.kernel.settle_samples()
+
+        """Recording the cpu time of the targets for the duration of the energy readings."""
+        self.record_targets_cputime(*snapshot["targets"])
+        server_cputime_sec = snapshot["server"] - before["server"]
+
+        """Correcting or rejecting intervals with misaligned inputs."""
+        # * Deltas whose windows differ from the energy window by more than
+        # * `max_skew` are rescaled to it (or the interval is rejected).
+        misalignment = snapshot.misalignment(before, "rapl", self.SCALED_SOURCES)
+        skew_sec = max(abs(sec) for sec in misalignment.values())
+        scales = dict.fromkeys(misalignment, 1.0)
+        rejected = False
+        if skew_sec > FLAGS.max_skew:
+            if FLAGS.skew_policy == "correct":
+                scales = snapshot.scales(before, "rapl", self.SCALED_SOURCES)
+                # * Targets found since the last snapshot were first read at
+                # * another time, so their deltas cover another window.
+                self.kernel.scale_cputime(
+                    scales["targets"], self.kernel.same_tasks(*self.slots_before)
+                )
+                server_cputime_sec = server_cputime_sec * scales["server"]
+                logger.debug(f"Corrected interval inputs with {skew_sec=:.4f}s")
+            else:
+                rejected = True
+                logger.warning(f"Rejected interval with {skew_sec=:.4f}s")
+        total_server_cputime_sec = (
+            server_cputime_sec[:, FIELD_INDEX["user"]]
+            + server_cputime_sec[:, FIELD_INDEX["system"]]
+        )
+
+        """Crediting kernel work (irq, softirq and kernel threads) by I/O share."""
+        kernel_cputime_sec = None
+        if self.kernel_work:
+            kthread_sec, io_share = snapshot["kernel"]
+            kthread_sec = kthread_sec * scales.get("kernel", 1.0)
+            irq_sec = (
+                server_cputime_sec[:, FIELD_INDEX["irq"]]
+                + server_cputime_sec[:, FIELD_INDEX["softirq"]]
+            )
+            # * Kernel threads already run as system time, interrupts don't.
+            total_server_cputime_sec += irq_sec
+            kernel_cputime_sec = io_share * (irq_sec + kthread_sec)
+            if round(time.time()) % FLAGS.logging == 0:
+                logger.debug(
+                    f"Kernel work: irq={irq_sec}s, kthreads={kthread_sec}s, "
+                    f"{io_share=:.3f}"
+                )
 
-        targets_alive = True
+        """Subtracting static energy to get attributable energy."""
+        pkg_percents, dram_percents = self.check_baseline_power()
+        base_energy_j = self.compute_baseline_energy_joules(duration_sec)
+        delta_energy_j = total_energy_j - base_energy_j
 
-        with ProcessSignalHandler() as sighandler:
-            while True:
-                elapsed = time.perf_counter() - ts_before
-                interval_delta_sec = rapl_interval_sec - elapsed
-                if interval_delta_sec < 0:
-                    logger.warn(
-                        f"One lap exceeded RAPL interval by {-interval_delta_sec}s"
+        if (delta_energy_j < 0).any():
+            delta_energy_j[delta_energy_j < 0] = 0
+            logger.warn(f"Total energy less than baseline energy!")
+
+        self.baseline_consumption += base_energy_j
+
+        """Ascribing energy from delta."""
+        if rejected:
+            ascribed_energy_j = np.zeros_like(delta_energy_j)
+            credit_fracs = np.zeros_like(delta_energy_j)
+            tracer_energy_j = np.zeros_like(delta_energy_j)
+        else:
+            ascribed_energy_j, credit_fracs, tracer_energy_j = self.ascribe_energy(
+                delta_energy_j,
+                total_server_cputime_sec,
+                cpu_credit_fracs,
+                cycle_counts,
+                mem_traffic,
+                kernel_cputime_sec,
+            )
+        self.ascribable_consumption += ascribed_energy_j
+
+        """Breaking down the ascribed energy by task."""
+        top_tasks = None
+        tenants = None
+        if (
+            self.task_traces or FLAGS.top_k > 0 or self.tsdb or self.rollups
+        ) and not rejected:
+            slots, cpu_j, dram_j = self.kernel.task_energy(
+                ascribed_energy_j[0], ascribed_energy_j[1]
+            )
+            comms = self.task_comms(slots)
+            if self.task_traces:
+                self.collect_task_results(slots, cpu_j, dram_j, comms)
+            if FLAGS.top_k > 0:
+                top_tasks = self.kernel.rank_tasks(
+                    slots, cpu_j + dram_j, comms, FLAGS.top_k
+                )
+            tenants = self.tenant_energy(slots, cpu_j, dram_j)
+            if self.tsdb:
+                self.record_tenant_series(*tenants)
+            if self.rollups:
+                self.record_rollups(
+                    duration_sec, total_energy_j, ascribed_energy_j, *tenants
+                )
+        if self.tsdb:
+            for socket in range(self.num_cpu_sockets):
+                for domain, i in (("pkg", 0), ("dram", 1)):
+                    self.tsdb.append(
+                        f"socket{socket}/total_{domain}_joules",
+                        total_energy_j[i][socket],
                     )
-                else:
-                    time.sleep(interval_delta_sec)
-
-                """Reading energy from RAPL interface."""
-                # * [2 x num_sockets]: Column i is the (cpu, dram) of socket i.
-                readings_now = self.read_pkg_mem_joules()
-                ts_now = time.perf_counter()
-                total_energy_j = np.array(readings_now) - np.array(readings_before)
-                if (total_energy_j < 0).any():
-                    overflow_indices = np.where(total_energy_j < 0)
-                    total_energy_j[overflow_indices] = +self.max_energy_ranges_j[
-                        overflow_indices
-                    ]
-                    logger.warn(
-                        f"Negative energy reading occurred -> Max RAPL ranges exceeded."
+                    self.tsdb.append(
+                        f"socket{socket}/ascribed_{domain}_joules",
+                        ascribed_energy_j[i][socket],
                     )
+        """Resetting the per-interval status of all targets."""
+        self.kernel.reset_samples()
+        # * Sampling follows the tasks that ran in this interval.
+        self.kernel.plan_sampling()
+
+        results = (
+            duration_sec,
+            skew_sec,
+            total_energy_j,
+            base_energy_j,
+            ascribed_energy_j,
+            tracer_energy_j,
+            credit_fracs,
+            pkg_percents,
+            dram_percents,
+            top_tasks,
+        )
+        self.collect_results(*results)
+        if self.sighandler.stopped or not self.targets_alive:
+            self.collect_results(*results, flash=True)
+            self.scheduler.stop()
+            return
 
-                total_consumption += total_energy_j
-                duration_sec = ts_now - ts_before
+        """Carrying results to the next interval."""
+        self.snapshot_before = snapshot
+        self.slots_before = self.kernel.generations()
 
-                """Recording the cpu time of the targets for the duration of the energy readings."""
-                self.record_targets_cputime()
-                server_cputime_now = self.get_server_cputime()
-                total_server_cputime_sec = np.array(server_cputime_now) - np.array(
-                    server_cputime_before
-                )
+    def discover_targets(self):
+        """Updates the targets and checks if they are still alive."""
+        self.targets_alive = self.update_targets()
+        self.sync_targets_status()
+        if self.kernel_work:
+            self.kernel_work.refresh()
+        if self.tsdb:
+            self.tsdb.evict()
 
-                """Subtracting static energy to get attributable energy."""
-                pkg_percents, dram_percents = self.check_baseline_power()
-                base_energy_j = self.compute_baseline_energy_joules(duration_sec)
-                delta_energy_j = total_energy_j - base_energy_j
+    def read_kernel_work(self):
+        """Reads kernel-thread runtime and the I/O share of the targets' thread
+        groups (excluding the tracer).
 
-                if (delta_energy_j < 0).any():
-                    delta_energy_j[delta_energy_j < 0] = 0
-                    logger.warn(f"Total energy less than baseline energy!")
+        :return: {Tuple} ([num_sockets] kernel-thread seconds, I/O share)
+        """
+        tgids = {
+            self.target_tgids.get(pid, pid)
+            for pid in self.targets_status
+            if pid != self.tracer_process.pid
+        }
+        return (
+            self.kernel_work.read_kthread_deltas(),
+            self.kernel_work.io_share(tgids),
+        )
 
-                baseline_consumption += base_energy_j
+    def sample_residence(self):
+        """Samples the current socket of the active slots planned by the kernel."""
+        rows = self.kernel.sampled_slots()[0]
+        tids, gens = self.kernel.tids[rows].tolist(), self.kernel.gens[rows].tolist()
+        # * Only active tasks are kept around.
+        for gen in self.sampled_tasks.keys() - set(gens):
+            self.sampled_tasks.pop(gen)
 
-                """Ascribing energy from delta."""
-                ascribed_energy_j, credit_fracs, tracer_energy_j = self.ascribe_energy(
-                    delta_energy_j, total_server_cputime_sec
-                )
-                ascribable_consumption += ascribed_energy_j
-
-                """Updating the targets and check if they are still alive."""
-                targets_alive = self.update_targets()
-                """Creating new status for all targets."""
-                self.empty_targets_status()
-
-                self.collect_results(
-                    duration_sec,
-                    total_energy_j,
-                    base_energy_j,
-                    ascribed_energy_j,
-                    tracer_energy_j,
-                    credit_fracs,
-                    pkg_percents,
-                    dram_percents,
+        slots, sockets = [], []
+        for slot, tid, gen in zip(rows.tolist(), tids, gens):
+            try:
+                if gen not in self.sampled_tasks:
+                    self.sampled_tasks[gen] = psutil.Process(tid)
+                core = self.sampled_tasks[gen].cpu_num()
+            except psutil.NoSuchProcess:
+                # * Removed at the end of the interval.
+                continue
+            slots.append(slot)
+            sockets.append(self.core_pkg_map[core])
+        self.kernel.record_residence(
+            np.array(slots, dtype=np.int64), np.array(sockets, dtype=np.int64)
+        )
+
+    def sample_counters(self):
+        """Keeps the raw energy counters (uJ) of every socket in the store."""
+        ts = time.time()
+        pkg_readings, dram_readings = self.read_pkg_mem_joules()
+        for socket in range(self.num_cpu_sockets):
+            for domain, readings in (("pkg", pkg_readings), ("dram", dram_readings)):
+                self.tsdb.append(
+                    f"socket{socket}/{domain}_uj",
+                    round(readings[socket] * 1e6),
+                    ts,
+                    counter=True,
                 )
 
-                if sighandler.stopped or not targets_alive:
-                    self.collect_results(
-                        duration_sec,
-                        total_energy_j,
-                        base_energy_j,
-                        ascribed_energy_j,
-                        tracer_energy_j,
-                        credit_fracs,
-                        pkg_percents,
-                        dram_percents,
-                        flash=True,
-                    )
+    def tenant_energy(
+        self, slots: np.ndarray, cpu_j: np.ndarray, dram_j: np.ndarray
+    ) -> Tuple[np.ndarray, np.ndarray, np.ndarray]:
+        """Sums the energy of tasks by thread group (tenant).
 
-                    print()
-                    logger.warn(f"Tracer was stopped!!!")
-                    logger.info(
-                        f"Total duration: {datetime.timedelta(seconds=time.perf_counter()-ts_start)}"
-                    )
-                    for socket in range(self.num_cpu_sockets):
-                        logger.info(
-                            f"Total energy of {socket=} (pkg, dram):"
-                            f"\t {total_consumption[:, socket]} J"
-                        )
-                        logger.info(
-                            f"Baseline energy of {socket=} (pkg, dram):"
-                            f"\t {baseline_consumption[:, socket]} J"
-                        )
-                        logger.info(
-                            f"Ascribed energy of {socket=} (pkg, dram):"
-                            f"{ascribable_consumption[:, socket]} J"
-                        )
-                    return
-
-                """Carrying results to the next iteration."""
-                server_cputime_before, readings_before, ts_before = (
-                    server_cputime_now,
-                    readings_now,
-                    ts_now,
+        :return: {Tuple} (tenant TGIDs, [tenants x num_sockets] CPU energy,
+            [tenants x num_sockets] DRAM energy)
+        """
+        tenants, inverse = np.unique(self.kernel.tgids[slots], return_inverse=True)
+        tenant_cpu_j = np.zeros((tenants.size, self.num_cpu_sockets))
+        tenant_dram_j = np.zeros((tenants.size, self.num_cpu_sockets))
+        np.add.at(tenant_cpu_j, inverse, cpu_j)
+        np.add.at(tenant_dram_j, inverse, dram_j)
+        return tenants, tenant_cpu_j, tenant_dram_j
+
+    def record_tenant_series(
+        self, tenants: np.ndarray, cpu_j: np.ndarray, dram_j: np.ndarray
+    ):
+        """Keeps the energy of every thread group (tenant) in the store."""
+        ts = time.time()
+        for tenant, cpu, dram in zip(
+            tenants.tolist(), cpu_j.sum(axis=1), dram_j.sum(axis=1)
+        ):
+            self.tsdb.append(f"tenant{tenant}/cpu_joules", cpu, ts)
+            self.tsdb.append(f"tenant{tenant}/dram_joules", dram, ts)
+
+    def record_rollups(
+        self,
+        duration_sec: float,
+        total_energy_j: np.ndarray,
+        ascribed_energy_j: np.ndarray,
+        tenants: np.ndarray,
+        tenant_cpu_j: np.ndarray,
+        tenant_dram_j: np.ndarray,
+    ):
+        """Adds the energy of the interval per socket, domain and tenant (the whole
+        socket, the targets, or one of their thread groups) to the rollups."""
+        ts = time.time()
+        for socket in range(self.num_cpu_sockets):
+            for i, (domain, tenant_j) in enumerate(
+                (("pkg", tenant_cpu_j), ("dram", tenant_dram_j))
+            ):
+                key = lambda tenant: (socket, domain, tenant)
+                self.rollups.add(
+                    ts, key("total"), total_energy_j[i][socket], duration_sec
                 )
+                self.rollups.add(
+                    ts, key("ascribed"), ascribed_energy_j[i][socket], duration_sec
+                )
+                for tenant, joules in zip(tenants.tolist(), tenant_j[:, socket]):
+                    self.rollups.add(ts, key(str(tenant)), joules, duration_sec)
 
-            # *> End of tracer process loop.
+    def emit_rollup(self, level: str, rows: List[Dict[str, Any]]):
+        self.writer.submit("rollups", level, rows)
 
-    def sample_targets_status(self, sample_interval_s=FLAGS.rapl_period):
-        while True:
-            try:
-                socket_used_mem = self.read_socket_numa_mem_mib("MemUsed")
-
-                # * Get lock, making sure the tracer thread doesn't delete everything at this point.
-                self.mutex.acquire()
-
-                # * Collect system-wide memory usages.
-                for socket in range(self.num_cpu_sockets):
-                    self.server_numa_mem_samples[socket].append(socket_used_mem[socket])
-
-                disappeared_targets = []
-                for status in self.targets_status.values():
-                    exists = target_exists(status.target.pid)
-                    if not exists:
-                        # ? Can/should we preserve partial results?
-                        logger.warn(
-                            f"(daemon) Stopped tracing status of {status.target.pid}"
-                        )
-                        disappeared_targets.append(status.target.pid)
-                        continue
-
-                    """Accumulating target residence counters."""
-                    try:
-                        core = status.target.cpu_num()
-                        socket = self.core_pkg_map[core]
-                        count = status.cpu_socket_residence_counters.get(socket, 0)
-                        status.cpu_socket_residence_counters[socket] = count + 1
-                    except psutil.NoSuchProcess:
-                        logger.warn(f"{status.target.pid} has gone, but {exists=}")
-                        continue
-
-                    """Accumulating target private memory per socket."""
-                    private_mem = self.get_target_private_mem_mib(status.target.pid)
-                    for _socket in range(self.num_cpu_sockets):
-                        samples = status.numa_mem_samples.get(_socket, [])
-                        samples.append(private_mem[_socket])  # * Add new samples.
-                        status.numa_mem_samples[_socket] = samples  # * Put them back.
-
-                # * Update targets in case of deletion.
-                for pid in disappeared_targets:
-                    if pid in self.target_processes:
-                        self.target_processes.remove(pid)
-                    if pid in self.target_threads:
-                        self.target_threads.remove(pid)
-                    del self.targets_status[pid]
-
-            finally:
-                # * Always release the lock s.t. the main tracer process terminates.
-                self.mutex.release()
-
-            time.sleep(sample_interval_s)
-        # *> End of while loop.
+    def write_rollup(self, level: str, rows: List[Dict[str, Any]]):
+        """Appends the rows of closed windows to the file of their level."""
+        path = f"{self.trace_base}_{level}.csv"
+        pd.DataFrame(rows).to_csv(
+            path, mode="a", header=not os.path.isfile(path), index=False
+        )
+
+    def sample_memory(self):
+        """Samples the private memory of a slice of the owners of active thread groups.
+
+        Owners are visited round-robin so that each of them is sampled exactly
+        once per `mem_period`: every tick earns `owners / ticks` of a sample, and
+        ticks that have not earned a whole one are skipped (no `numastat` call).
+        """
+        owners = self.kernel.sampled_slots()[1]
+        if owners.size == 0:
+            return
+        ticks_per_sweep = max(1, round(FLAGS.mem_period / FLAGS.rapl_period))
+        self.mem_credit += owners.size
+        chunk = self.mem_credit // ticks_per_sweep
+        if chunk == 0:
+            return
+        self.mem_credit -= chunk * ticks_per_sweep
+        self.mem_cursor %= owners.size
+        owners = np.roll(owners, -self.mem_cursor)[:chunk]
+        self.mem_cursor += chunk
+
+        socket_used_mem = self.read_socket_numa_mem_mib("MemUsed")
+        private_mem = [
+            self.get_target_private_mem_mib(tid)
+            for tid in self.kernel.tids[owners].tolist()
+        ]
+        self.kernel.record_memory(owners, private_mem, socket_used_mem)
 
     def ascribe_energy(
-        self, total_energy_j: npt.ArrayLike, total_server_cputime_sec: npt.ArrayLike
+        self,
+        total_energy_j: npt.ArrayLike,
+        total_server_cputime_sec: npt.ArrayLike,
+        cpu_credit_fracs: npt.ArrayLike = None,
+        cycle_counts: Tuple[float, npt.ArrayLike] = None,
+        mem_traffic: Tuple[float, npt.ArrayLike] = None,
+        kernel_cputime_sec: npt.ArrayLike = None,
     ):
         """Computes ascribable CPU pkg and DRAM energies.
 
         :param total_energy_j: {npt.ArrayLike} [[pkg1, pkg2, ...], [mem1, mem2, ...]]
         :param total_server_cputime_sec: {npt.ArrayLike} [socket1, socket2, ...]
+        :param cpu_credit_fracs: {npt.ArrayLike} [socket1, socket2, ...] counter-based
+            CPU credit fractions replacing the cputime share (optional)
+        :param cycle_counts: {Tuple[float, npt.ArrayLike]} (unhalted cycles of the
+            targets, [socket1, socket2, ...] unhalted cycles of the host) (optional)
+        :param mem_traffic: {Tuple[float, npt.ArrayLike]} (LLC misses of the targets,
+            [socket1, socket2, ...] DRAM CAS lines of the host) (optional)
+        :param kernel_cputime_sec: {npt.ArrayLike} [socket1, socket2, ...] kernel
+            work done on behalf of the targets (optional)
         :return: Ascribable energies in Joules.
         """
-        is_tracer = lambda _id: _id in [
-            self.tracer_process.pid,
-            self.tracer_daemon_thread.native_id,
-        ]
-
         ascribable_energy_j = np.zeros_like(total_energy_j)
         tracer_energy_j = np.zeros_like(total_energy_j)
         if not self.targets_status:
             # * No active targets.
-            return ascribable_energy_j
+            return ascribable_energy_j, np.zeros_like(total_energy_j), tracer_energy_j
 
-        # * Get lock since so that no new samples can be added.
-        self.mutex.acquire()
+        # * Distribute cpu times to sockets given corresponding residence probabilities.
+        targets_cputime, tracer_cpu = self.kernel.cputime_per_socket()
+        ascribable_cputime = targets_cputime
+        if kernel_cputime_sec is not None:
+            ascribable_cputime = targets_cputime + kernel_cputime_sec
+        # * Threads share memory with other threads of the same process group,
+        # * so only one task per group has been sampled.
+        mem_ratios, tracer_mem_ratios, private_mem_mib = self.kernel.memory_per_socket()
 
-        ascribable_cputime = [0.0] * self.num_cpu_sockets
-        tracer_cpu = [0.0] * self.num_cpu_sockets
-        # ! Assume that all targets have the same #samples since no new targets are added during sampling,
-        # ! although some dead/inactive ones might be deleted by the daemon.
-        num_mem_samples = len(
-            next(iter(self.targets_status.values())).numa_mem_samples[0]
+        # * Prevent numeric errors.
+        SMALL_CONST = 1e-5
+        total_server_cputime_sec = np.asarray(total_server_cputime_sec)
+        gamma_cpu, delta_mem = FLAGS.gamma, FLAGS.delta
+        # * [2 x num_sockets]: Column i is the (cpu, dram) of socket i.
+        cpu_energy, dram_energy = total_energy_j[0], total_energy_j[1]
+
+        """Crediting CPU package energy."""
+        if cycle_counts is not None:
+            cpu_credit_fracs = self.compute_cycle_credit_fracs(
+                targets_cputime, *cycle_counts
+            )
+        if cpu_credit_fracs is not None:
+            # * Activity weight from hardware counters (e.g., cgroup cycles).
+            cpu_fracs = np.maximum(SMALL_CONST, cpu_credit_fracs)
+            if kernel_cputime_sec is not None:
+                # ! Counters miss the kernel work done for the targets elsewhere
+                # ! (e.g., softirqs), so it's credited by its cputime share.
+                cpu_fracs = np.minimum(
+                    1.0,
+                    cpu_fracs
+                    + credit_fracs(kernel_cputime_sec, total_server_cputime_sec),
+                )
+        else:
+            cpu_fracs = credit_fracs(
+                ascribable_cputime, total_server_cputime_sec, empty=SMALL_CONST
+            )
+        power_law_energy(cpu_energy, cpu_fracs, gamma_cpu, out=ascribable_energy_j[0])
+
+        """Crediting DRAM energy."""
+        if mem_traffic is not None:
+            # * Share of the memory traffic served by each socket.
+            mem_fracs = np.maximum(
+                SMALL_CONST,
+                self.compute_traffic_credit_fracs(
+                    private_mem_mib, ascribable_cputime, *mem_traffic
+                ),
+            )
+        else:
+            # * Mean of the per-sample private/server ratios:
+            # * more robust to outliers but losing memory peaks.
+            mem_fracs = np.clip(mem_ratios, SMALL_CONST, 1.0)
+        power_law_energy(dram_energy, mem_fracs, delta_mem, out=ascribable_energy_j[1])
+
+        """Crediting tracer energy."""
+        tracer_cpu_fracs = credit_fracs(tracer_cpu, total_server_cputime_sec)
+        power_law_energy(
+            cpu_energy, tracer_cpu_fracs, gamma_cpu, out=tracer_energy_j[0]
+        )
+        tracer_mem_fracs = np.minimum(1.0, tracer_mem_ratios)
+        power_law_energy(
+            dram_energy, tracer_mem_fracs, delta_mem, out=tracer_energy_j[1]
         )
-        accumulated_private_mem_samples = {
-            socket: np.array([0.0] * num_mem_samples)
-            for socket in range(self.num_cpu_sockets)
-        }
-        tracer_mem_samples = {
-            socket: np.array([0.0] * num_mem_samples)
-            for socket in range(self.num_cpu_sockets)
-        }
 
-        ascribed_threads = set()
+        if round(time.time()) % FLAGS.logging == 0:
+            for socket in range(self.num_cpu_sockets):
+                logger.debug(
+                    f"{socket=}: cpu_credit_frac={cpu_fracs[socket]: .3f}, "
+                    f"mem_credit_frac={mem_fracs[socket]: .3f}"
+                )
+                logger.debug(
+                    f"{socket=}: tracer_cpu_frac={tracer_cpu_fracs[socket]: .3f}, "
+                    f"tracer_mem_frac={tracer_mem_fracs[socket]: .3f}"
+                )
 
-        for _, status in self.targets_status.items():
-            if not target_exists(status.target.pid):
-                continue
+        return ascribable_energy_j, np.array([cpu_fracs, mem_fracs]), tracer_energy_j
 
-            """Ascribing CPU energy."""
-            target_cputime = status.cputime_delta
-            socket_residence_probs = status.compute_socket_residence_probs(
-                self.num_cpu_sockets
-            )
-            # * Distribute cpu times to sockets given corresponding residence probabilities.
-            for socket in range(self.num_cpu_sockets):
-                cputime = target_cputime * socket_residence_probs[socket]
-                # * Tracer runtime.
-                if is_tracer(status.target.pid):
-                    tracer_cpu[socket] += cputime
-                else:
-                    ascribable_cputime[socket] += cputime
-
-            """Ascribing DRAM energy."""
-            is_thread = False
-            if status.target.pid in self.target_threads:
-                is_thread = True
-                if status.target.pid in ascribed_threads:
-                    # * Dedupe: Threads share memory with other threads of the same process group.
-                    continue
+    def open_cgroup_counters(self):
+        """Opens per-cgroup perf counters if `cpu_credit=cgroup`.
 
-            for socket in range(self.num_cpu_sockets):
-                # * Accumulate memory sample points across targets.
-                if is_tracer(status.target.pid):
-                    tracer_mem_samples[socket] += np.array(
-                        status.numa_mem_samples[socket]
-                    )
-                else:
-                    accumulated_private_mem_samples[socket] += np.array(
-                        status.numa_mem_samples[socket]
-                    )
+        :return: {CgroupCounters} None if disabled or unsupported
+            (falling back to cputime-based credits).
+        """
+        if FLAGS.cpu_credit != "cgroup":
+            return None
+        if not FLAGS.cgroup:
+            logger.error("`cpu_credit=cgroup` requires `-cgroup`, using cputime")
+            return None
+        try:
+            return CgroupCounters(FLAGS.cgroup, self.core_pkg_map)
+        except OSError as e:
+            logger.error(f"Failed to open cgroup counters ({e}), using cputime")
+            return None
+
+    def compute_cycle_credit_fracs(
+        self,
+        ascribable_cputime: np.ndarray,
+        target_cycles: float,
+        server_cycles: np.ndarray,
+    ):
+        """Credits unhalted cycles of the targets to sockets.
 
-            # * Dedupe.
-            if is_thread:
-                siblings = {t.id for t in status.target.threads()}
-                ascribed_threads.update(siblings)
+        Inherited counters fold children into their ancestors, so the cycles are
+        distributed over sockets like the (residence-weighted) cputime of the targets.
 
-        # * Prevent numeric errors.
-        SMALL_CONST = 1e-5
-        credit_fracs = self.get_empty_energy_readings()
-        ascribable_cputime = np.array(ascribable_cputime)
-        for socket in range(self.num_cpu_sockets):
-            # * [2 x num_sockets]: Column i is the (cpu, dram) of socket i.
-            cpu_energy, dram_energy = total_energy_j[:, socket]
-
-            """Crediting CPU package energy."""
-            gamma_cpu = FLAGS.gamma
-            cpu_credit_frac = (
-                min(1.0, ascribable_cputime[socket] / total_server_cputime_sec[socket])
-                if total_server_cputime_sec[socket] > 0
-                else SMALL_CONST
-            )
-            ascribable_energy_j[0][socket] = cpu_energy * (cpu_credit_frac**gamma_cpu)
-            credit_fracs[0][socket] = cpu_credit_frac
-
-            """Crediting DRAM energy."""
-            server_mem_samples = np.array(self.server_numa_mem_samples[socket])
-            mem_indices_zeros = np.where(server_mem_samples == 0)
-            # * Prevent numeric errors for Option 1 while keeping Option 2 vaiable.
-            server_mem_samples[mem_indices_zeros] = SMALL_CONST
-            accumulated_private_mem_samples[socket][mem_indices_zeros] = SMALL_CONST
-
-            delta_mem = FLAGS.delta
-            # ? Option 1: more robust to outliers but losing memory peaks.
-            mem_credit_frac = min(
-                1.0,
-                (accumulated_private_mem_samples[socket] / server_mem_samples).mean(),
-            )
-            # ? Option 2: less robust to outliers.
-            # mem_credit_frac = min(1., accumulated_private_mem_samples[socket].sum()/server_mem_samples.sum())
+        :return: {np.ndarray} [num_sockets x 1] cycle-based credit fractions.
+        """
+        total_cputime = ascribable_cputime.sum()
+        socket_shares = (
+            ascribable_cputime / total_cputime
+            if total_cputime > 0
+            else np.full(self.num_cpu_sockets, 1.0 / self.num_cpu_sockets)
+        )
+        fracs = np.zeros(self.num_cpu_sockets)
+        has_cycles = server_cycles > 0
+        fracs[has_cycles] = np.minimum(
+            1.0, target_cycles * socket_shares[has_cycles] / server_cycles[has_cycles]
+        )
+        return fracs
 
-            ascribable_energy_j[1][socket] = dram_energy * (
-                mem_credit_frac**delta_mem
-            )
-            credit_fracs[1][socket] = mem_credit_frac
+    def compute_traffic_credit_fracs(
+        self,
+        private_mem_mib: np.ndarray,
+        ascribable_cputime: np.ndarray,
+        target_misses: float,
+        dram_lines: np.ndarray,
+    ):
+        """Credits DRAM traffic of the targets to the memory controllers of each socket.
 
-            """Crediting tracer energy."""
-            tracer_cpu_frac = min(
-                1.0, tracer_cpu[socket] / total_server_cputime_sec[socket]
-            )
-            tracer_energy_j[0][socket] = cpu_energy * (tracer_cpu_frac**gamma_cpu)
+        LLC misses of the targets are split over NUMA nodes by where their private
+        memory resides (or by their cputime if they hold no private memory).
 
-            tracer_mem_frac = min(
-                1.0, (tracer_mem_samples[socket] / server_mem_samples).mean()
-            )
-            # tracer_mem_frac = min(1., tracer_mem_samples[socket].sum()/server_mem_samples.sum())
-            tracer_energy_j[1][socket] = dram_energy * (tracer_mem_frac**delta_mem)
+        :return: {np.ndarray} [num_sockets x 1] traffic-based credit fractions.
+        """
+        if private_mem_mib.sum() > 0:
+            node_shares = private_mem_mib / private_mem_mib.sum()
+        elif ascribable_cputime.sum() > 0:
+            node_shares = ascribable_cputime / ascribable_cputime.sum()
+        else:
+            node_shares = np.full(self.num_cpu_sockets, 1.0 / self.num_cpu_sockets)
 
-            if round(time.time()) % FLAGS.logging == 0:
-                logger.debug(
-                    f"{socket=}: {cpu_credit_frac=: .3f}, {mem_credit_frac=: .3f}"
-                )
-                logger.debug(
-                    f"{socket=}: {tracer_cpu_frac=: .3f}, {tracer_mem_frac=: .3f}"
-                )
+        fracs = np.zeros(self.num_cpu_sockets)
+        has_traffic = dram_lines > 0
+        fracs[has_traffic] = np.minimum(
+            1.0, target_misses * node_shares[has_traffic] / dram_lines[has_traffic]
+        )
+        return fracs
+
+    def open_thread_counters(self):
+        """Attaches per-thread perf counters to all targets if `cpu_credit=cycles`
+        or DRAM traffic is credited.
+
+        :return: {ThreadCounters} None if disabled or unsupported
+            (falling back to cputime/RSS-based credits).
+        """
+        if FLAGS.cpu_credit != "cycles" and not self.imc_counters:
+            return None
+        try:
+            counters = ThreadCounters(self.core_pkg_map)
+        except OSError as e:
+            logger.error(f"Failed to open thread counters ({e}), using cputime/RSS")
+            if self.imc_counters:
+                self.imc_counters.close()
+                self.imc_counters = None
+            return None
+        attached = counters.attach(self.target_processes | self.target_threads)
+        logger.info(f"Attached thread counters to {attached} tasks")
+        return counters
+
+    def open_imc_counters(self):
+        """Opens uncore IMC counters if `dram_credit=traffic`.
+
+        :return: {ImcCounters} None if disabled or unsupported
+            (falling back to RSS-based credits).
+        """
+        if FLAGS.dram_credit != "traffic":
+            return None
+        try:
+            return ImcCounters(self.core_pkg_map)
+        except (OSError, ValueError, AssertionError) as e:
+            logger.error(f"Failed to open IMC counters ({e}), using RSS")
+            return None
+
+    def read_counter_activity(self):
+        """Reads the thread counters of all targets once (excluding the tracer).
+
+        :return: {Tuple} (cycle counts for `compute_cycle_credit_fracs()`,
+            memory traffic for `compute_traffic_credit_fracs()`), None if disabled
+        """
+        if not self.thread_counters:
+            return None, None
+
+        tracer_ids = {self.tracer_process.pid}
+        counts = np.zeros(len(ThreadCounters.GROUP_EVENTS))
+        for tid, delta in self.thread_counters.read_deltas().items():
+            if tid not in tracer_ids:
+                counts += delta
+        server_cycles = self.thread_counters.system.read_deltas()
+
+        cycles, instructions, ref_cycles, llc_misses = counts
+        if round(time.time()) % FLAGS.logging == 0 and cycles > 0:
+            logger.debug(
+                f"Targets: IPC={instructions / cycles: .2f}, "
+                f"freq ratio={cycles / max(ref_cycles, 1): .2f}"
+            )
 
-        self.mutex.release()
-        return ascribable_energy_j, credit_fracs, tracer_energy_j
+        cycle_counts = (cycles, server_cycles) if FLAGS.cpu_credit == "cycles" else None
+        mem_traffic = (
+            (llc_misses, self.imc_counters.read_deltas()) if self.imc_counters else None
+        )
+        return cycle_counts, mem_traffic
 
     def launch(self):
         if not self.baseline.estimated:
@@ -422,12 +810,26 @@ class EnergyTracer(object):
 
     def stop(self):
         self.tracer_process.terminate()
-        # * (The daemon will stop at this point)
+        if self.ring:
+            # * Frames from `live_traces()` stay valid.
+            self.ring.unlink()
         return
 
+    def live_traces(self, start: int = 0) -> pd.DataFrame:
+        """Reads the latest traces of the running tracer from shared memory (with
+        `live_rows`), without the trace files.
+
+        Numeric columns are views of the shared ring (unless the rows wrap around
+        it), so rows older than `live_rows` may be overwritten while in use.
+
+        :param start: First row (counted from the start of tracing) to read.
+        """
+        assert self.ring, "Live traces are disabled (live_rows=0)"
+        return self.ring.to_dataframe(start)
+
     def __enter__(self):
         self.launch()
-        return
+        return self
 
     def __exit__(self, *args):
         # * Wait for the tracer process to start.
@@ -539,44 +941,99 @@ class EnergyTracer(object):
             self.baseline.dram_powers_watt * duration_sec
         )
 
-    def record_targets_cputime(self):
-        assert self.targets_status, "Empty status (potential uninitialized)."
+    def read_targets_cputime(self):
+        """Reads the cumulative cputimes of all targets (without recording them).
 
-        # ! Get lock before modifing the shared status.
-        self.mutex.acquire()
+        :return: {Tuple} (slots, cputimes, CPUs last run on, disappeared targets)
+        """
+        assert self.targets_status, "Empty status (potential uninitialized)."
 
         disappeared_targets = []
+        slots, cputimes, cpus = [], [], []
         for pid, status in self.targets_status.items():
-            success = status.record_cputime()
-            if not success:
-                logger.warn(f"(tracer proc) Stopped tracing status of {pid=}")
+            cputime, cpu = read_cputime_and_cpu(pid)
+            if cpu < 0:
+                # * Gone (possibly between checking and reading its stat).
                 disappeared_targets.append(pid)
+                continue
+            slots.append(status.slot)
+            cputimes.append(cputime)
+            cpus.append(cpu)
+        return np.array(slots, dtype=np.int64), cputimes, cpus, disappeared_targets
 
-        for pid in disappeared_targets:
-            if pid in self.target_processes:
-                self.target_processes.remove(pid)
-            if pid in self.target_threads:
-                self.target_threads.remove(pid)
-            del self.targets_status[pid]
+    def record_targets_cputime(
+        self,
+        slots: np.ndarray,
+        cputimes: List[float],
+        cpus: List[int],
+        disappeared_targets: List[int],
+    ):
+        """Records the cputimes read by `read_targets_cputime()`."""
+        self.kernel.update_cputime(slots, cputimes)
+        if self.placement:
+            # * A pinned task seen on another socket has changed its affinity.
+            sockets = np.array([self.core_pkg_map[cpu] for cpu in cpus])
+            for slot in self.kernel.unpin_strays(slots, sockets).tolist():
+                self.placement.invalidate(int(self.kernel.tids[slot]))
 
-        self.mutex.release()
+        for pid in disappeared_targets:
+            logger.warning(f"(tracer proc) Stopped tracing status of {pid=}")
+            self.remove_target(pid)
         return
 
-    def empty_targets_status(self):
-        targets = self.target_processes.copy()
-        targets.update(self.target_threads)
+    def sync_targets_status(self):
+        """Registers new targets and drops departed ones in place.
 
-        # * Get the lock before deleting everything s.t. the daemon is safe.
-        self.mutex.acquire()
-        self.targets_status = {
-            pid: TargetStatus(pid) for pid in targets if target_exists(pid)
-        }
-        self.server_numa_mem_samples = {
-            socket: [] for socket in range(self.num_cpu_sockets)
-        }
-        self.mutex.release()
+        Slots of known targets are kept along with their last cputime (read by
+        `record_targets_cputime()`), so only new targets are read and registered.
+        The sampled slots are planned again for the new targets.
+        """
+        targets = self.target_processes | self.target_threads
+        tracer_ids = {self.tracer_process.pid}
+
+        for pid in self.targets_status.keys() - targets:
+            self.remove_target(pid)
+
+        new_targets = []
+        for pid in targets - self.targets_status.keys():
+            if not target_exists(pid):
+                continue
+            try:
+                status = TargetStatus(pid, -1)
+            except psutil.NoSuchProcess:
+                continue
+            cputime, cpu = read_cputime_and_cpu(pid)
+            if cpu < 0:
+                continue
+            status.slot = self.kernel.add(
+                pid,
+                self.target_tgids.get(pid, pid),
+                cputime,
+                is_tracer=pid in tracer_ids,
+            )
+            if status.slot < 0:
+                logger.warn(f"Not tracing {pid=}: more than {FLAGS.max_tasks} tasks")
+                continue
+            self.targets_status[pid] = status
+            new_targets.append(pid)
+        if self.thread_counters and new_targets:
+            self.thread_counters.attach(new_targets)
+
+        if self.placement:
+            for pid, socket in self.placement.refresh(self.targets_status).items():
+                self.kernel.pin(self.targets_status[pid].slot, socket)
+        self.kernel.plan_sampling()
         return
 
+    def remove_target(self, pid: int):
+        """Stops tracing a target."""
+        self.target_processes.discard(pid)
+        self.target_threads.discard(pid)
+        self.targets_status.pop(pid, None)
+        self.kernel.remove(pid)
+        if self.thread_counters:
+            self.thread_counters.detach(pid)
+
     def update_targets(self) -> True:
         """Updates monitored targets.
 
@@ -585,6 +1042,8 @@ class EnergyTracer(object):
         inadmissible_status = ["terminated", psutil.STATUS_DEAD, psutil.STATUS_ZOMBIE]
         processes = set()
         threads = set()
+        # * Thread ID -> thread group ID.
+        tgids = {}
 
         if not target_exists(self.target_process.pid):
             logger.warn(
@@ -604,6 +1063,7 @@ class EnergyTracer(object):
             for thread in self.target_process.threads():
                 # * NB: the main thread is included.
                 threads.add(thread.id)
+                tgids[thread.id] = self.target_process.pid
         else:
             processes.add(self.target_process.pid)
 
@@ -616,6 +1076,7 @@ class EnergyTracer(object):
                 if child_process.num_threads() > 1:
                     for thread in child_process.threads():
                         threads.add(thread.id)
+                        tgids[thread.id] = child_process.pid
                         if thread.id not in self.target_threads:
                             logger.info(
                                 f"Added {thread.id=} to targets (from {child_process.pid}: #threads={child_process.num_threads()})"
@@ -635,16 +1096,16 @@ class EnergyTracer(object):
         removed_threads = self.target_threads - threads
         if removed_processes and removed_processes != {self.tracer_process.pid}:
             logger.info(f"Removed processes {removed_processes} from targets")
-        if removed_threads and removed_threads != {self.tracer_daemon_thread.native_id}:
+        if removed_threads:
             logger.info(f"Removed processes {removed_threads} from targets")
 
         # * Update monitoring targets.
         self.target_processes, self.target_threads = processes, threads
 
-        # * Always track the tracer process and daemon thread explicitly
-        # * in case they are not children of the target (i.e., attach mode).
+        # * Always track the tracer process explicitly
+        # * in case it is not a child of the target (i.e., attach mode).
         self.target_processes.add(self.tracer_process.pid)
-        self.target_threads.add(self.tracer_daemon_thread.native_id)
+        self.target_tgids = tgids
         return True
 
     def read_pkg_mem_joules(self) -> Tuple[List[float], List[float]]:
@@ -718,6 +1179,7 @@ class EnergyTracer(object):
     def collect_results(
         self,
         duration_sec: float,
+        skew_sec: float,
         total_energy_joules: npt.ArrayLike,
         base_energy_joules: npt.ArrayLike,
         ascribed_energy_joules: npt.ArrayLike,
@@ -725,33 +1187,24 @@ class EnergyTracer(object):
         credit_fracs: List[float],
         pkg_percents: List[float],
         dram_percents: List[float],
+        top_tasks: Tuple[List[List[Tuple]], List[List[Tuple]]] = None,
         flash=False,
     ):
         """Sinks results and periodically writes out.
 
         :param total_energy_consumption: [num_sockets x (pkg, dram)]
         :param ascribable_energy_consumption: [num_sockets x (pkg, dram)]
+        :param top_tasks: Heaviest tasks per socket in the interval and since the
+            start (see `AttributionKernel.rank_tasks()`).
         """
 
-        def flash_results():
-            self.iolock.acquire()
-            df = pd.DataFrame(self.traces)
-            if os.path.isfile(self.trace_file):
-                prevdf = pd.read_csv(self.trace_file)
-                df = pd.concat([prevdf, df])
-            df.to_csv(self.trace_file, index=False)
-            # total_duration = df.duration_sec.sum()
-            logger.info(f"Energy traces saved to {self.trace_file}")
-            self.traces = []
-            self.iolock.release()
-            return
-
         ts = time.time()
         for socket in range(self.num_cpu_sockets):
             record = {
                 "time": ts,
                 "socket": socket,
                 "duration_sec": duration_sec,
+                "skew_sec": skew_sec,
                 "num_proc": len(self.target_processes),
                 "num_threads": len(self.target_threads),
                 "pkg_credit_frac": credit_fracs[0][socket],
@@ -767,15 +1220,132 @@ class EnergyTracer(object):
                 "pkg_percent": pkg_percents[socket],
                 "dram_percent": dram_percents[socket],
             }
+            if FLAGS.top_k > 0:
+                # * "tid/comm=joules;..." (upper bounds of the totals).
+                interval, total = top_tasks or ([[]] * self.num_cpu_sockets,) * 2
+                record["top_tasks"] = ";".join(
+                    f"{tid}/{comm}={joules:.3f}"
+                    for tid, comm, joules in interval[socket]
+                )
+                record["top_tasks_total"] = ";".join(
+                    f"{tid}/{comm}={joules:.3f}"
+                    for tid, comm, joules, *_ in total[socket]
+                )
             self.traces.append(record)
+        if self.ring:
+            self.ring.append(self.traces[-self.num_cpu_sockets :])
+        self.trace_tenants.update(
+            self.target_tgids.get(pid, pid)
+            for pid in self.targets_status
+            if pid != self.tracer_process.pid
+        )
 
-        # total_duration = 0
-        if flash or len(self.traces) >= 100:
-            logger.info("Flash results")
-            thread = threading.Thread(target=flash_results)
-            thread.start()
+        if flash:
+            self.flush_results(force=True)
         return
 
+    def task_comms(self, slots: np.ndarray) -> np.ndarray:
+        """:return: {np.ndarray} Command names of the tasks in `slots`."""
+        return np.array(
+            [
+                self.targets_status[tid].comm if tid in self.targets_status else ""
+                for tid in self.kernel.tids[slots].tolist()
+            ],
+            dtype=COMM_DTYPE,
+        )
+
+    def collect_task_results(
+        self,
+        slots: np.ndarray,
+        cpu_j: np.ndarray,
+        dram_j: np.ndarray,
+        comms: np.ndarray,
+    ):
+        """Sinks the per-task and per-process breakdowns of the ascribed energy.
+
+        Only (task, socket) pairs with ascribed energy are recorded.
+
+        :param cpu_j: [len(slots) x num_sockets] CPU energy of each task.
+        :param dram_j: [len(slots) x num_sockets] DRAM energy of each task.
+        """
+        ts = time.time()
+        tids, tgids = self.kernel.tids[slots], self.kernel.tgids[slots]
+        rows, sockets = np.nonzero(cpu_j + dram_j > 0)
+        tasks = {
+            "time": np.full(rows.size, ts),
+            "tid": tids[rows],
+            "tgid": tgids[rows],
+            "comm": comms[rows],
+            "socket": sockets,
+            "cpu_joules": cpu_j[rows, sockets],
+            "dram_joules": dram_j[rows, sockets],
+        }
+
+        """Rolling up tasks into processes (named after their main threads)."""
+        groups, first, inverse = np.unique(
+            tgids, return_index=True, return_inverse=True
+        )
+        leaders = np.flatnonzero(tids == tgids)
+        first[inverse[leaders]] = leaders
+        proc_cpu_j = np.zeros((groups.size, self.num_cpu_sockets))
+        proc_dram_j = np.zeros((groups.size, self.num_cpu_sockets))
+        np.add.at(proc_cpu_j, inverse, cpu_j)
+        np.add.at(proc_dram_j, inverse, dram_j)
+        num_threads = np.bincount(inverse, minlength=groups.size)
+        rows, sockets = np.nonzero(proc_cpu_j + proc_dram_j > 0)
+        processes = {
+            "time": np.full(rows.size, ts),
+            "tgid": groups[rows],
+            "comm": comms[first][rows],
+            "socket": sockets,
+            "num_threads": num_threads[rows],
+            "cpu_joules": proc_cpu_j[rows, sockets],
+            "dram_joules": proc_dram_j[rows, sockets],
+        }
+        self.task_traces.append(tasks, processes)
+
+    def flush_results(self, force=False):
+        """Hands the collected traces over to the sinks (which batch them as
+        they need, e.g., 100 records for CSV files), and the per-task records to
+        the writer (every 10k records, unless forced).
+
+        Binary traces and live sinks get every interval, so a crash loses at most
+        one interval (plus what has not been `fsync()`-ed, on power loss).
+        """
+        if self.task_traces and (force or self.task_traces.num_rows >= 10000):
+            self.writer.submit("tasks", *self.task_traces.take())
+        if self.traces or force:
+            # * The sinks share the records from now on.
+            traces, self.traces = self.traces, []
+            tenants, self.trace_tenants = self.trace_tenants, set()
+            self.sinks.submit(traces, tenants, force=force)
+        if round(time.time()) % FLAGS.logging == 0:
+            logger.debug(f"Sinks {self.sinks.metrics()}")
+            logger.debug(f"Writer {self.writer.metrics()}")
+
+    def write_task_traces(
+        self, tasks: Dict[str, np.ndarray], processes: Dict[str, np.ndarray]
+    ):
+        path = self.task_traces.write(tasks, processes)
+        logger.info(f"Per-task traces saved to {path}")
+
+    def open_sinks(self) -> List[Sink]:
+        """Opens the trace file (segmented if `segment_sec`) and `trace_sinks`."""
+        fsync = dict(fsync_sec=FLAGS.fsync_sec, fsync_bytes=FLAGS.fsync_bytes)
+        specs = list(FLAGS.trace_sinks)
+        sinks = []
+        if FLAGS.segment_sec > 0:
+            sinks.append(
+                SegmentSink(
+                    self.trace_file, FLAGS.segment_sec, FLAGS.trace_format, **fsync
+                )
+            )
+        else:
+            specs.insert(0, FLAGS.trace_format)
+        for spec in dict.fromkeys(specs):
+            sinks.append(parse_sink(spec, self.trace_base, **fsync))
+        return sinks
+
     def read_socket_numa_mem_mib(self, kind):
         """Reads NUMA memories of the specified `kind`.
 
@@ -804,17 +1374,19 @@ class EnergyTracer(object):
         return private_memories
 
     def get_server_cputime(self):
-        """Get system-wide cpu time for each socket.
+        """Get system-wide (user + system) cpu time for each socket.
 
-        :return: {List[float]} [num_sockets x 1]
+        :return: {np.ndarray} [num_sockets x 1]
         """
-        cputime_per_socket = self.get_empty_energy_readings()[0]
-        server_cputimes: List["CpuTimes"] = psutil.cpu_times(percpu=True)
-        for core, cputimes in enumerate(server_cputimes):
-            socket = self.core_pkg_map[core]
-            cputime = cputimes.system + cputimes.user
-            cputime_per_socket[socket] += cputime
-        return cputime_per_socket
+        breakdown = self.proc_stat.read_sockets()
+        return breakdown[:, FIELD_INDEX["user"]] + breakdown[:, FIELD_INDEX["system"]]
+
+    def get_server_cputime_breakdown(self):
+        """Get system-wide cpu time of every /proc/stat category for each socket.
+
+        :return: {np.ndarray} [num_sockets x len(PROC_STAT_FIELDS)]
+        """
+        return self.proc_stat.read_sockets()
 
     def get_core_pkg_mapping(self) -> Dict[int, int]:
         core_pkg_map = {}
@@ -0,0 +1,261 @@
+import bisect
+import time
+from typing import *
+
+import numpy as np
+
+"""Buckets of zigzag-encoded delta-of-deltas: (prefix, prefix bits, value bits)."""
+DOD_BUCKETS = ((0b10, 2, 7), (0b110, 3, 12), (0b1110, 4, 20), (0b11110, 5, 32))
+DOD_ESCAPE = (0b11111, 5, 64)
+
+
+class Block(NamedTuple):
+    t_first: int
+    t_last: int
+    count: int
+    times: bytes
+    values: bytes
+
+    @property
+    def nbytes(self) -> int:
+        return len(self.times) + len(self.values) + 3 * 8
+
+
+def pack_bits(fields: List[Tuple[int, int]]) -> bytes:
+    """Packs (value, width) fields MSB-first into bytes."""
+    if not fields:
+        return b""
+    values = np.array([value for value, _ in fields], dtype=np.uint64)
+    widths = np.array([width for _, width in fields])
+    bits = (values[:, None] >> np.arange(63, -1, -1, dtype=np.uint64)) & np.uint64(1)
+    keep = np.arange(64) >= 64 - widths[:, None]
+    return np.packbits(bits[keep].astype(np.uint8)).tobytes()
+
+
+class BitReader(object):
+    def __init__(self, data: bytes):
+        # * Padding lets any field of up to 64 bits be read from 9 bytes.
+        self.data = data + b"\0" * 9
+        self.pos = 0
+
+    def read(self, width: int) -> int:
+        if width == 0:
+            return 0
+        byte, shift = divmod(self.pos, 8)
+        window = int.from_bytes(self.data[byte : byte + 9], "big")
+        self.pos += width
+        return (window >> (72 - shift - width)) & ((1 << width) - 1)
+
+    def read_unary(self, limit: int) -> int:
+        """:return: {int} Number of leading 1 bits (up to `limit`)."""
+        ones = 0
+        while ones < limit and self.read(1):
+            ones += 1
+        return ones
+
+
+def encode_dod(values: np.ndarray) -> bytes:
+    """Encodes integers by their delta-of-deltas (the first delta against 0)."""
+    fields = [(int(values[0]) & (2**64 - 1), 64)]
+    dods = np.diff(np.diff(values, prepend=values[:1]), prepend=0)[1:]
+    for dod in dods.tolist():
+        if dod == 0:
+            fields.append((0, 1))
+            continue
+        zigzag = ((dod << 1) ^ (dod >> 63)) & (2**64 - 1)
+        for prefix, prefix_bits, bits in DOD_BUCKETS:
+            if zigzag < 1 << bits:
+                break
+        else:
+            prefix, prefix_bits, bits = DOD_ESCAPE
+        fields += [(prefix, prefix_bits), (zigzag, bits)]
+    return pack_bits(fields)
+
+
+def decode_dod(data: bytes, count: int) -> np.ndarray:
+    reader = BitReader(data)
+    values = np.empty(count, dtype=np.uint64)
+    value = values[0] = reader.read(64)
+    delta = 0
+    widths = [bits for _, _, bits in DOD_BUCKETS + (DOD_ESCAPE,)]
+    for i in range(1, count):
+        ones = reader.read_unary(len(widths))
+        if ones > 0:
+            zigzag = reader.read(widths[ones - 1])
+            delta += (zigzag >> 1) ^ -(zigzag & 1)
+        # * Wraps around (mod 2**64) like the int64 differences of the encoder.
+        value = (value + delta) & (2**64 - 1)
+        values[i] = value
+    return values.view(np.int64)
+
+
+def encode_xor(values: np.ndarray) -> bytes:
+    """Encodes floats by XOR-ing their bits with the previous value (Gorilla)."""
+    bits = values.astype(np.float64).view(np.uint64).tolist()
+    fields = [(bits[0], 64)]
+    lead, trail = 65, 65
+    for prev, curr in zip(bits, bits[1:]):
+        xor = prev ^ curr
+        if xor == 0:
+            fields.append((0, 1))
+            continue
+        curr_lead = min(31, 64 - xor.bit_length())
+        curr_trail = (xor & -xor).bit_length() - 1
+        if curr_lead >= lead and curr_trail >= trail:
+            # * Within the window of the previous value.
+            fields += [(0b10, 2), (xor >> trail, 64 - lead - trail)]
+        else:
+            lead, trail = curr_lead, curr_trail
+            length = 64 - lead - trail
+            fields += [(0b11, 2), (lead, 5), (length & 63, 6), (xor >> trail, length)]
+    return pack_bits(fields)
+
+
+def decode_xor(data: bytes, count: int) -> np.ndarray:
+    reader = BitReader(data)
+    bits = [reader.read(64)]
+    lead, trail = 0, 0
+    for _ in range(1, count):
+        if not reader.read(1):
+            bits.append(bits[-1])
+            continue
+        if reader.read(1):
+            lead = reader.read(5)
+            trail = 64 - lead - (reader.read(6) or 64)
+        bits.append(bits[-1] ^ (reader.read(64 - lead - trail) << trail))
+    return np.array(bits, dtype=np.uint64).view(np.float64)
+
+
+class Series(object):
+    """A time series: sealed compressed blocks and an uncompressed head block.
+
+    Timestamps (integers in the store's time unit) are delta-of-delta encoded.
+    Values are XOR-encoded floats, or delta-of-delta encoded integers for
+    counters.
+    """
+
+    def __init__(self, counter: bool, block_size: int):
+        self.counter = counter
+        self.block_size = block_size
+        self.blocks: List[Block] = []
+        self.head_times = np.empty(block_size, dtype=np.int64)
+        self.head_values = np.empty(block_size, np.int64 if counter else np.float64)
+        self.head_len = 0
+
+    def append(self, t: int, value):
+        self.head_times[self.head_len] = t
+        self.head_values[self.head_len] = value
+        self.head_len += 1
+        if self.head_len == self.block_size:
+            self.seal()
+
+    def seal(self):
+        n = self.head_len
+        if n == 0:
+            return
+        times, values = self.head_times[:n], self.head_values[:n]
+        encode = encode_dod if self.counter else encode_xor
+        self.blocks.append(
+            Block(int(times[0]), int(times[-1]), n, encode_dod(times), encode(values))
+        )
+        self.head_len = 0
+
+    def decode(self, block: Block) -> Tuple[np.ndarray, np.ndarray]:
+        decode = decode_dod if self.counter else decode_xor
+        return decode_dod(block.times, block.count), decode(block.values, block.count)
+
+    def query(self, t0: int, t1: int) -> Tuple[np.ndarray, np.ndarray]:
+        """:return: (times, values) in [t0, t1], decoding only overlapping blocks."""
+        first = bisect.bisect_left([block.t_last for block in self.blocks], t0)
+        parts = []
+        for block in self.blocks[first:]:
+            if block.t_first > t1:
+                break
+            parts.append(self.decode(block))
+        parts.append(
+            (self.head_times[: self.head_len], self.head_values[: self.head_len])
+        )
+        times = np.concatenate([times for times, _ in parts])
+        values = np.concatenate([values for _, values in parts])
+        keep = (times >= t0) & (times <= t1)
+        return times[keep], values[keep]
+
+    def evict(self, t: int):
+        """Drops blocks that end before `t`."""
+        keep = bisect.bisect_left([block.t_last for block in self.blocks], t)
+        del self.blocks[:keep]
+
+    def last_time(self) -> int:
+        if self.head_len > 0:
+            return int(self.head_times[self.head_len - 1])
+        return self.blocks[-1].t_last if self.blocks else -(2**63)
+
+    @property
+    def nbytes(self) -> int:
+        return (
+            sum(block.nbytes for block in self.blocks)
+            + self.head_times.nbytes
+            + self.head_values.nbytes
+        )
+
+
+class TimeSeriesStore(object):
+    """In-memory store of compressed time series with a bounded retention.
+
+    Samples are appended to the head block of their series, which is compressed
+    once full. Queries decode only the blocks overlapping the time range, and
+    blocks older than `retention_sec` are dropped as new ones are sealed.
+    """
+
+    def __init__(
+        self,
+        retention_sec: float = 24 * 3600,
+        block_size: int = 1024,
+        time_unit: float = 1e-3,
+    ):
+        self.retention_sec = retention_sec
+        self.block_size = block_size
+        self.time_unit = time_unit
+        self.series: Dict[str, Series] = {}
+
+    def append(self, key: str, value, t: float = None, counter=False):
+        """Appends a sample to a series (created on first use).
+
+        :param t: Time in seconds (now by default).
+        :param counter: If the series holds integers (e.g., cumulative counters).
+        """
+        t = round((time.time() if t is None else t) / self.time_unit)
+        if key not in self.series:
+            self.series[key] = Series(counter, self.block_size)
+        series = self.series[key]
+        num_blocks = len(series.blocks)
+        series.append(t, value)
+        if len(series.blocks) > num_blocks:
+            series.evict(t - round(self.retention_sec / self.time_unit))
+
+    def query(
+        self, key: str, t0: float = -np.inf, t1: float = np.inf
+    ) -> Tuple[np.ndarray, np.ndarray]:
+        """:return: {Tuple[np.ndarray, np.ndarray]} (times in seconds, values)
+        of a series in [t0, t1]."""
+        series = self.series[key]
+        bound = lambda t, default: default if np.isinf(t) else round(t / self.time_unit)
+        times, values = series.query(bound(t0, -(2**63)), bound(t1, 2**63 - 1))
+        return times * self.time_unit, values
+
+    def evict(self, t: float = None):
+        """Drops blocks older than the retention, and series without newer samples."""
+        cutoff = round(
+            ((time.time() if t is None else t) - self.retention_sec) / self.time_unit
+        )
+        for key, series in list(self.series.items()):
+            series.evict(cutoff)
+            if series.last_time() < cutoff:
+                del self.series[key]
+
+    def keys(self) -> List[str]:
+        return list(self.series)
+
+    @property
+    def nbytes(self) -> int:
+        return sum(series.nbytes for series in self.series.values())
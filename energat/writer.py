@@ -0,0 +1,180 @@
+import os
+import pickle
+import tempfile
+import threading
+import time
+from collections import deque
+from typing import *
+
+from energat.common import logger
+
+"""Policies when all pending slots of the writer are taken."""
+POLICIES = ("block", "drop_oldest", "spill")
+
+
+class AsyncWriter(object):
+    """A long-lived thread writing batches handed over by the attribution loop.
+
+    The loop fills a batch while the thread writes the previous ones, and hands
+    it over with `submit()` (without copying: the loop starts a new batch). At
+    most `max_pending` batches wait to be written; beyond that, `policy` decides:
+    - block: `submit()` waits for a free slot,
+    - drop_oldest: the oldest pending batch is dropped,
+    - spill: batches are pickled to a spill file (in `spill_dir`) and written
+      in order once the thread catches up.
+
+    Spilled batches are pickled and written (and read back) outside the lock:
+    a spill reserves its place in order under the lock, and is only taken by
+    the thread once its bytes are in the file.
+    """
+
+    def __init__(
+        self,
+        sinks: Dict[str, Callable[..., Any]],
+        policy: str = "block",
+        max_pending: int = 4,
+        spill_dir: str = None,
+    ):
+        assert policy in POLICIES, f"{policy=}"
+        assert max_pending > 0, f"{max_pending=}"
+        self.sinks = sinks
+        self.policy = policy
+        self.max_pending = max_pending
+        self.spill_dir = spill_dir
+        self.pending: Deque[Tuple[str, tuple]] = deque()
+        self.cond = threading.Condition()
+        self.closed = False
+        # * Spilled batches are read back in order by the writer thread, as
+        # * [offset, length] extents of the file (None until written).
+        self.spill_file = (
+            tempfile.TemporaryFile(prefix="energat-spill-", dir=spill_dir)
+            if policy == "spill"
+            else None
+        )
+        self.spill_extents: Deque[List[int]] = deque()
+        self.spill_end = 0
+        self.spill_reading = False
+
+        """Metrics."""
+        self.submitted = 0
+        self.written = 0
+        self.dropped = 0
+        self.spilled = 0
+        self.blocked_sec = 0.0
+        self.max_depth = 0
+        self.write_sec = 0.0
+        self.max_write_sec = 0.0
+
+        self.thread = threading.Thread(target=self.loop, name="energat-writer")
+        self.thread.start()
+
+    @property
+    def depth(self) -> int:
+        """Batches waiting to be written (pending or spilled)."""
+        return len(self.pending) + len(self.spill_extents)
+
+    def submit(self, sink: str, *args):
+        """Hands a batch over to be written as `sinks[sink](*args)`."""
+        extent = None
+        with self.cond:
+            assert not self.closed, "Writer is closed"
+            self.submitted += 1
+            if self.spill_extents:
+                # * Keep the order behind batches that have been spilled.
+                extent = self.reserve_spill()
+            elif len(self.pending) < self.max_pending:
+                self.pending.append((sink, args))
+            elif self.policy == "block":
+                began = time.perf_counter()
+                self.cond.wait_for(lambda: len(self.pending) < self.max_pending)
+                self.blocked_sec += time.perf_counter() - began
+                self.pending.append((sink, args))
+            elif self.policy == "drop_oldest":
+                self.pending.popleft()
+                self.dropped += 1
+                self.pending.append((sink, args))
+            else:
+                extent = self.reserve_spill()
+            self.max_depth = max(self.max_depth, self.depth)
+            self.cond.notify_all()
+        if extent is not None:
+            self.spill(extent, sink, args)
+
+    def reserve_spill(self) -> List[int]:
+        """Takes the next place in order for a spilled batch (under the lock)."""
+        extent = [None, None]
+        self.spill_extents.append(extent)
+        self.spilled += 1
+        return extent
+
+    def spill(self, extent: List[int], sink: str, args: tuple):
+        data = pickle.dumps((sink, args), pickle.HIGHEST_PROTOCOL)
+        with self.cond:
+            if self.spill_extents[0] is extent and not self.spill_reading:
+                # * Nothing left to read: reuse the file from its start.
+                self.spill_end = 0
+            offset = self.spill_end
+            self.spill_end += len(data)
+        os.pwrite(self.spill_file.fileno(), data, offset)
+        with self.cond:
+            extent[:] = offset, len(data)
+            self.cond.notify_all()
+
+    def take(self) -> Optional[Tuple[str, tuple]]:
+        """:return: The next batch in order (None once closed and drained)."""
+        with self.cond:
+            self.cond.wait_for(lambda: self.depth > 0 or self.closed)
+            if self.pending:
+                self.cond.notify_all()
+                return self.pending.popleft()
+            elif not self.spill_extents:
+                return None
+            # * Wait for the oldest spilled batch to be in the file.
+            self.cond.wait_for(lambda: self.spill_extents[0][1] is not None)
+            offset, length = self.spill_extents.popleft()
+            self.spill_reading = True
+            self.cond.notify_all()
+        data = os.pread(self.spill_file.fileno(), length, offset)
+        with self.cond:
+            self.spill_reading = False
+        return pickle.loads(data)
+
+    def loop(self):
+        while True:
+            batch = self.take()
+            if batch is None:
+                return
+            sink, args = batch
+            began = time.perf_counter()
+            try:
+                self.sinks[sink](*args)
+            except Exception as e:
+                logger.error(f"Failed to write a batch to {sink}: {e!r}")
+            elapsed = time.perf_counter() - began
+            with self.cond:
+                self.written += 1
+                self.write_sec += elapsed
+                self.max_write_sec = max(self.max_write_sec, elapsed)
+
+    def close(self):
+        """Writes out all batches and stops the thread."""
+        with self.cond:
+            self.closed = True
+            self.cond.notify_all()
+        self.thread.join()
+        if self.spill_file is not None:
+            self.spill_file.close()
+
+    def metrics(self) -> Dict[str, float]:
+        with self.cond:
+            return {
+                "depth": self.depth,
+                "max_depth": self.max_depth,
+                "submitted": self.submitted,
+                "written": self.written,
+                "dropped": self.dropped,
+                "spilled": self.spilled,
+                "blocked_sec": self.blocked_sec,
+                "mean_write_sec": self.write_sec / max(1, self.written),
+                "max_write_sec": self.max_write_sec,
+            }
@@ -0,0 +1,151 @@
+import numpy as np
+
+from energat.kernel import (
+    AttributionKernel,
+    ScratchArena,
+    SlotMap,
+    credit_fracs,
+    power_law_energy,
+)
+
+
+def test_slot_map():
+    slot_map = SlotMap(16)
+    tids = np.arange(1000, 1300)
+    for slot, tid in enumerate(tids):
+        slot_map.insert(int(tid), slot)
+    for tid in tids[::2]:
+        slot_map.remove(int(tid))
+
+    slots = slot_map.lookup(tids)
+    assert len(slot_map) == 150
+    assert (slots[::2] == -1).all()
+    assert (slots[1::2] == np.arange(1, 300, 2)).all()
+    assert slot_map.get(42) == -1
+
+
+def test_kernel():
+    kernel = AttributionKernel(num_sockets=2, capacity=2)
+    # * Two threads of one group, a single-threaded process, and the tracer.
+    a = kernel.add(11, 10, cputime=1.0)
+    b = kernel.add(12, 10, cputime=2.0)
+    c = kernel.add(20, 20, cputime=0.0)
+    t = kernel.add(30, 30, cputime=0.0, is_tracer=True)
+    slots = np.array([a, b, c, t])
+
+    kernel.plan_sampling()
+    owners = kernel.sampled_slots()[1]
+    # * Samples of the previous interval are cleared.
+    kernel.record_residence(slots, np.zeros(4, dtype=np.int64))
+    kernel.record_memory(owners, [[1, 1]] * 3, [1, 1])
+    kernel.settle_samples()
+    kernel.reset_samples()
+
+    kernel.update_cputime(slots, [2.0, 4.0, 1.0, 0.5])
+    kernel.record_residence(np.array([a, a, b, c]), np.array([0, 1, 1, 0]))
+    for _ in range(2):
+        kernel.record_memory(owners, np.full((3, 2), 10.0), [100.0, 50.0])
+    kernel.settle_samples()
+
+    cputime, tracer_cputime = kernel.cputime_per_socket()
+    # * a: 1s split evenly, b: 2s on socket 1, c: 1s on socket 0.
+    assert np.allclose(cputime, [1.5, 2.5])
+    # * The tracer hasn't been sampled, so it keeps its last residence.
+    assert np.allclose(tracer_cputime, [0.5, 0.0])
+
+    mem_ratios, tracer_ratios, mem_mib = kernel.memory_per_socket()
+    # * The thread group {11, 12} is sampled once.
+    assert np.allclose(mem_ratios, [0.2, 0.4])
+    assert np.allclose(tracer_ratios, [0.1, 0.2])
+    assert np.allclose(mem_mib, [20.0, 20.0])
+
+    # * Only c runs next: idle tasks and their thread groups are not sampled.
+    kernel.update_cputime(slots, [2.0, 4.0, 3.0, 0.5])
+    kernel.plan_sampling()
+    residence_slots, memory_slots = kernel.sampled_slots()
+    assert residence_slots.tolist() == [c] and memory_slots.tolist() == [c]
+
+    # * Memory sampling is handed over to the remaining sibling, and the
+    # * removed task is no longer sampled (even before the next plan).
+    kernel.update_cputime(slots, [3.0, 4.0, 3.0, 0.5])
+    kernel.plan_sampling()
+    assert a in kernel.sampled_slots()[0]
+    kernel.remove(11)
+    assert kernel.mem_owner[b] and len(kernel) == 3
+    assert a not in kernel.sampled_slots()[0]
+    assert kernel.add(40, 40, cputime=0.0) == a
+
+
+def test_credit_math():
+    fracs = credit_fracs([1.0, 3.0, 1.0], [2.0, 2.0, 0.0], empty=1e-5)
+    assert np.allclose(fracs, [0.5, 1.0, 1e-5])
+
+    energy = np.zeros(3)
+    power_law_energy([8.0, 8.0, 8.0], [0.25, 1.0, 0.0], 0.5, out=energy)
+    assert np.allclose(energy, [4.0, 8.0, 0.0])
+
+
+def test_scratch_arena():
+    arena = ScratchArena(nbytes=256)
+    a = arena.take(8, fill=1.0)
+    b = arena.take((2, 4), np.int64, fill=2)
+    assert not np.shares_memory(a, b) and np.shares_memory(a, arena.block)
+    # * Overflowing requests fall back to the heap until the arena grows.
+    c = arena.take(64)
+    assert not np.shares_memory(c, arena.block)
+    arena.reset()
+    assert arena.block.size >= 2 * 64 * 8 and arena.offset == 0
+
+
+def test_task_energy():
+    kernel = AttributionKernel(num_sockets=2)
+    a = kernel.add(11, 10, cputime=0.0)
+    b = kernel.add(12, 10, cputime=0.0)
+    c = kernel.add(20, 20, cputime=0.0)
+    kernel.add(30, 30, cputime=0.0, is_tracer=True)
+    kernel.update_cputime(np.array([a, b, c]), [1.0, 3.0, 0.0])
+    kernel.residence[[a, b]] = [[1, 0], [1, 1]]
+    kernel.mem_samples[[a, c]] = 1
+    kernel.mem_ratio_acc[[a, c]] = [[0.3, 0.0], [0.1, 0.2]]
+
+    slots, cpu_j, dram_j = kernel.task_energy(
+        np.array([10.0, 6.0]), np.array([8.0, 4.0])
+    )
+    assert slots.tolist() == [a, b, c]
+    # * Socket 0: a 1s and b 1.5s, socket 1: b 1.5s.
+    assert np.allclose(cpu_j, [[4.0, 0.0], [6.0, 6.0], [0.0, 0.0]])
+    # * Group 10 holds 3/4 of socket 0's ratio, split 1:3 by cputime.
+    assert np.allclose(dram_j, [[1.5, 0.0], [4.5, 0.0], [2.0, 4.0]])
+
+
+def test_pinned_residence():
+    kernel = AttributionKernel(num_sockets=2)
+    a = kernel.add(11, 10, cputime=0.0)
+    b = kernel.add(12, 10, cputime=0.0)
+    kernel.pin(b, 1)
+    kernel.plan_sampling()
+    # * Only the task that may migrate is sampled.
+    assert kernel.sampled_slots()[0].tolist() == [a]
+
+    kernel.update_cputime(np.array([a, b]), [1.0, 1.0])
+    kernel.settle_samples()
+    assert np.allclose(kernel.residence_probs(np.array([a, b])), [[0.5, 0.5], [0, 1]])
+    # * Seen on socket 0, b may migrate again.
+    assert kernel.unpin_strays(np.array([a, b]), np.array([0, 0])).tolist() == [b]
+
+
+def test_scale_cputime():
+    kernel = AttributionKernel(num_sockets=2)
+    a = kernel.add(11, 10, cputime=0.0)
+    b = kernel.add(12, 10, cputime=0.0)
+    before = kernel.generations()
+    # * 13 takes over the slot of 12, and 14 a new one, after the snapshot.
+    kernel.remove(12)
+    c = kernel.add(13, 10, cputime=0.0)
+    d = kernel.add(14, 10, cputime=0.0)
+    assert c == b
+
+    kernel.update_cputime(np.array([a, c, d]), [1.0, 1.0, 1.0])
+    kernel.scale_cputime(2.0, kernel.same_tasks(*before))
+    # * Only the task read in both snapshots is rescaled.
+    assert kernel.cputime_delta[[a, c, d]].tolist() == [2.0, 1.0, 1.0]
@@ -0,0 +1,36 @@
+import ctypes
+import os
+import struct
+
+from energat.perf import (
+    PerfEventAttr,
+    parse_cpu_list,
+    parse_pmu_event,
+    read_group,
+    read_single,
+)
+
+
+def test_perf():
+    # * PERF_ATTR_SIZE_VER8.
+    assert ctypes.sizeof(PerfEventAttr) == 136
+
+    # * Group of two counters multiplexed half of the time.
+    rfd, wfd = os.pipe()
+    os.write(wfd, struct.pack("5Q", 2, 100, 50, 10, 20))
+    assert list(read_group(rfd, 2)) == [20.0, 40.0]
+
+    os.write(wfd, struct.pack("3Q", 7, 100, 100))
+    assert read_single(rfd) == 7.0
+    os.close(rfd)
+    os.close(wfd)
+
+
+def test_pmu_event(tmp_path):
+    (tmp_path / "events").mkdir()
+    (tmp_path / "format").mkdir()
+    (tmp_path / "events" / "cas_count_read").write_text("event=0x04,umask=0x03\n")
+    (tmp_path / "format" / "event").write_text("config:0-7\n")
+    (tmp_path / "format" / "umask").write_text("config:8-15\n")
+    assert parse_pmu_event(str(tmp_path), "cas_count_read") == 0x0304
+    assert parse_cpu_list("0-3,8,10-11\n") == {0, 1, 2, 3, 8, 10, 11}
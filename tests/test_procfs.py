@@ -0,0 +1,80 @@
+import numpy as np
+
+from energat.common import CLK_TCK_PER_SEC
+from energat.procfs import (
+    FIELD_INDEX,
+    CpuPlacement,
+    ProcStatReader,
+    parse_diskstats,
+    parse_io_bytes,
+    parse_cpu_list,
+    parse_net_dev,
+    parse_task_stat,
+)
+
+PROC_STAT = b"""cpu  40 0 40 400 0 4 4 0 0 0
+cpu0 10 0 10 100 0 1 1 0 0 0
+cpu1 10 0 10 100 0 1 1 0 0 0
+cpu3 20 0 20 200 0 2 2 0 0 0
+intr 1 2 3
+ctxt 42
+"""
+
+
+def test_proc_stat(tmp_path):
+    stat = tmp_path / "stat"
+    stat.write_bytes(PROC_STAT)
+    # * cpu2 is offline, cpu3 is outside of the mapping.
+    reader = ProcStatReader({0: 0, 1: 1, 2: 1}, path=str(stat))
+    cpus, times = reader.read_cpus()
+    assert cpus.tolist() == [0, 1, 3]
+    assert times[2, FIELD_INDEX["user"]] * CLK_TCK_PER_SEC == 20
+
+    per_socket = reader.read_sockets() * CLK_TCK_PER_SEC
+    assert per_socket.shape == (2, 10)
+    assert np.allclose(per_socket[:, FIELD_INDEX["system"]], [10, 10])
+    assert np.allclose(per_socket[:, FIELD_INDEX["softirq"]], [1, 1])
+    reader.close()
+
+
+def test_io_parsers():
+    assert parse_task_stat("42 (kworker/0:1 x) I 2 0 0")[:2] == ["I", "2"]
+    assert parse_io_bytes("rchar: 100\nwchar: 20\nread_bytes: 4096\n") == 120
+    diskstats = (
+        "   8       0 sda 1 0 10 0 1 0 6 0 0 0 0\n"
+        "   8       1 sda1 1 0 10 0 1 0 6 0 0 0 0\n"
+        "   7       0 loop0 1 0 10 0 1 0 6 0 0 0 0\n"
+    )
+    assert parse_diskstats(diskstats, {"sda"}) == 16 * 512
+    net_dev = (
+        "Inter-|   Receive\n face |bytes    packets\n"
+        "    lo: 500 5 0 0 0 0 0 0 500 5 0 0 0 0 0 0\n"
+        "  eth0: 300 3 0 0 0 0 0 0 200 2 0 0 0 0 0 0\n"
+    )
+    assert parse_net_dev(net_dev) == 500
+
+
+def test_cpu_placement(tmp_path):
+    assert parse_cpu_list("0-2,5,7-8\n") == {0, 1, 2, 5, 7, 8}
+    for tid, cgroup in ((11, "/pinned"), (12, "/shared")):
+        (tmp_path / str(tid)).mkdir()
+        (tmp_path / str(tid) / "cgroup").write_text(f"0::{cgroup}\n")
+        (tmp_path / cgroup[1:]).mkdir()
+    (tmp_path / "pinned" / "cpuset.cpus.effective").write_text("2-3\n")
+    (tmp_path / "shared" / "cpuset.cpus.effective").write_text("0-3\n")
+    affinity = {11: {0, 1, 2, 3}, 12: {0, 1, 2, 3}, 13: {1}}
+    placement = CpuPlacement(
+        {0: 0, 1: 0, 2: 1, 3: 1},
+        procfs=str(tmp_path),
+        cgroupfs=str(tmp_path),
+        getaffinity=affinity.get,
+    )
+    # * 11 by its cpuset, 13 by its affinity (without a cgroup).
+    assert placement.refresh([11, 12, 13]) == {11: 1, 12: -1, 13: 0}
+    assert placement.refresh([11, 12, 13]) == {}
+
+    (tmp_path / "shared" / "cpuset.cpus.effective").write_text("0-1\n")
+    assert placement.refresh([11, 12]) == {12: 0}
+    placement.invalidate(11)
+    affinity[11] = {0}
+    assert placement.refresh([11, 12]) == {11: -1}
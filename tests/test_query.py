@@ -0,0 +1,51 @@
+import numpy as np
+import pandas as pd
+
+from energat.query import aggregate, parse_query
+from energat.segments import SegmentWriter
+from energat.traceio import TraceWriter
+
+
+def make_records(times):
+    return [
+        {"time": float(t), "socket": socket, "joules": t + 10.0 * socket}
+        for t in times
+        for socket in range(2)
+    ]
+
+
+def test_aggregate(tmp_path):
+    pd.DataFrame(make_records(range(0, 10))).to_csv(tmp_path / "a.csv", index=False)
+    with TraceWriter(str(tmp_path / "b.etr")) as writer:
+        for t in range(10, 20, 5):
+            writer.append(make_records(range(t, t + 5)))
+    with SegmentWriter(str(tmp_path / "c_segments"), 10) as writer:
+        writer.append(make_records(range(20, 30)))
+    paths = [str(tmp_path / "*.csv"), str(tmp_path / "b.etr"), str(tmp_path / "c_*")]
+    df = pd.DataFrame(make_records(range(30)))
+
+    query = parse_query(
+        ["socket"],
+        ["count:time", "sum:joules", "mean:joules", "max:joules", "p50:joules"],
+    )
+    for workers in (1, 2):
+        result = aggregate(paths, query, workers)
+        expected = df.groupby("socket")["joules"]
+        assert result["socket"].tolist() == [0, 1]
+        assert result["count:time"].tolist() == [30, 30]
+        assert np.allclose(result["sum:joules"], expected.sum())
+        assert np.allclose(result["mean:joules"], expected.mean())
+        assert np.allclose(result["max:joules"], expected.max())
+        assert np.allclose(
+            result["p50:joules"],
+            expected.quantile(0.5, interpolation="lower"),
+            rtol=0.02,
+        )
+
+    # * Filters and time ranges (pruning row groups and segments).
+    query = parse_query([], ["sum:joules", "min:joules"], ["socket == 1"], 12, 24)
+    result = aggregate(paths, query)
+    kept = df[(df.socket == 1) & (df.time >= 12) & (df.time <= 24)]
+    assert result["sum:joules"].item() == kept["joules"].sum()
+    assert result["min:joules"].item() == 22.0
+    assert aggregate(paths, parse_query([], ["count:time"], ["socket > 5"])).empty
@@ -0,0 +1,51 @@
+import multiprocessing
+
+import numpy as np
+
+from energat.ring import TraceRing
+
+
+def append_rows(name: str, num_rows: int):
+    ring = TraceRing(name=name)
+    for t in range(num_rows):
+        ring.append(
+            [
+                {"time": float(t), "socket": socket, "joules": t + socket, "top": ""}
+                for socket in range(2)
+            ]
+        )
+    ring.close()
+
+
+def test_trace_ring():
+    ring = TraceRing(capacity=8)
+    assert ring.to_dataframe().empty
+    writer = multiprocessing.Process(target=append_rows, args=(ring.name, 3))
+    writer.start()
+    writer.join()
+
+    df = ring.to_dataframe()
+    assert list(df.columns) == ["time", "socket", "joules"]
+    assert df["joules"].tolist() == [0, 1, 1, 2, 2, 3]
+    # * Columns are views of the shared block.
+    assert np.shares_memory(df["joules"].to_numpy(), ring.data)
+    assert ring.to_dataframe(start=4)["time"].tolist() == [2.0, 2.0]
+    del df
+
+    # * 10 more rows wrap around: the oldest ones are overwritten.
+    writer = multiprocessing.Process(target=append_rows, args=(ring.name, 5))
+    writer.start()
+    writer.join()
+    assert ring.num_rows == 16 and ring.overrun(0) and not ring.overrun(8)
+    position, views = ring.read(8)
+    assert position == 16 and views["time"].tolist() == [1, 1, 2, 2, 3, 3, 4, 4]
+    del views
+    df = ring.to_dataframe(start=10)
+    assert df["time"].tolist() == [2, 2, 3, 3, 4, 4]
+    del df
+    # * Rows wrapping around the end of the ring are copied out.
+    writer = multiprocessing.Process(target=append_rows, args=(ring.name, 1))
+    writer.start()
+    writer.join()
+    assert ring.to_dataframe(start=10)["time"].tolist() == [2, 2, 3, 3, 4, 4, 0, 0]
+    ring.close()
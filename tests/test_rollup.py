@@ -0,0 +1,41 @@
+import numpy as np
+
+from energat.rollup import Rollups
+from energat.sketch import QuantileSketch
+
+
+def test_quantile_sketch():
+    rng = np.random.default_rng(0)
+    values = rng.lognormal(3.0, 1.0, size=10000)
+    sketch, other = QuantileSketch(0.01), QuantileSketch(0.01)
+    sketch.add(values[:5000])
+    other.add(values[5000:])
+    sketch.merge(other)
+    assert sketch.count == values.size
+    for q in (0.5, 0.9, 0.99):
+        exact = np.quantile(values, q, method="lower")
+        assert abs(sketch.quantile(q) - exact) <= 0.02 * exact
+    assert np.isnan(QuantileSketch().quantile(0.5))
+
+
+def test_rollups():
+    emitted = {}
+    rollups = Rollups(lambda level, rows: emitted.setdefault(level, []).extend(rows))
+    # * 0.5 s intervals over 3 minutes, at 10 W then 30 W.
+    for t in np.arange(0.5, 180.5, 0.5):
+        watts = 10.0 if t <= 90 else 30.0
+        rollups.add(t, (0, "pkg", "total"), watts * 0.5, 0.5)
+    rollups.flush()
+
+    seconds, minutes, hours = emitted["1s"], emitted["1min"], emitted["1h"]
+    assert len(seconds) == 181 and len(minutes) == 4 and len(hours) == 1
+    total = 10.0 * 90 + 30.0 * 90
+    for rows in (seconds, minutes, hours):
+        assert np.isclose(sum(row["joules"] for row in rows), total)
+    assert [row["time"] for row in minutes] == [0.0, 60.0, 120.0, 180.0]
+    assert minutes[0]["count"] == 119 and minutes[0]["max_watts"] == 10.0
+    (hour,) = hours
+    assert hour["count"] == 360
+    assert (hour["min_watts"], hour["max_watts"]) == (10.0, 30.0)
+    assert abs(hour["p50_watts"] - 10.0) <= 0.1
+    assert abs(hour["p99_watts"] - 30.0) <= 0.3
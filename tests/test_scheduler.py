@@ -0,0 +1,63 @@
+import logging
+
+from energat.common import logger
+from energat.scheduler import Scheduler
+
+
+class FakeClock(object):
+    def __init__(self):
+        self.now = 0.0
+
+    def __call__(self):
+        return self.now
+
+    def sleep(self, sec):
+        self.now += sec
+
+
+def test_scheduler():
+    clock = FakeClock()
+    scheduler = Scheduler(clock=clock, sleep=clock.sleep)
+    runs = []
+    fast = scheduler.add("fast", 0.1, lambda: runs.append(("fast", clock.now)))
+    slow = scheduler.add(
+        "slow", 0.25, lambda: runs.append(("slow", clock.now)), phase=0.05
+    )
+    scheduler.run(duration=0.5)
+
+    assert [round(t, 2) for name, t in runs if name == "fast"] == [
+        0,
+        0.1,
+        0.2,
+        0.3,
+        0.4,
+        0.5,
+    ]
+    assert [round(t, 2) for name, t in runs if name == "slow"] == [0.05, 0.3]
+    assert fast.runs == 6 and slow.runs == 2 and fast.misses == 0
+
+
+def test_scheduler_overrun():
+    clock = FakeClock()
+    scheduler = Scheduler(clock=clock, sleep=clock.sleep)
+
+    def busy():
+        clock.now += 0.25
+        if clock.now > 1.0:
+            scheduler.stop()
+
+    task = scheduler.add("busy", 0.1, busy)
+    warnings = []
+    handler = logging.Handler(logging.WARNING)
+    handler.emit = warnings.append
+    logger.addHandler(handler)
+    try:
+        scheduler.run()
+    finally:
+        logger.removeHandler(handler)
+    # * Releases that passed during a run are skipped, keeping the phase grid.
+    assert task.runs == 4 and task.misses == 4 and task.skipped == 8
+    # * A single summary of the misses (once a second has passed).
+    assert [record.getMessage() for record in warnings] == [
+        "Deadline misses: busy x4 (worst 0.1500s late)"
+    ]
@@ -0,0 +1,64 @@
+import json
+import os
+
+import numpy as np
+import pytest
+
+from energat.segments import SegmentWriter, load_index, query
+from energat.traceio import TraceWriter, load_traces
+
+
+@pytest.mark.parametrize("fmt", ["csv", "binary"])
+def test_segments(tmp_path, fmt):
+    directory = str(tmp_path / "traces_segments")
+    with SegmentWriter(directory, 10, fmt) as writer:
+        for t in range(0, 40, 4):
+            # * Batches of 4 s (one per 2 s interval and socket) cross segments.
+            records = [
+                {"time": float(t + dt), "socket": socket, "joules": t + dt + socket}
+                for dt in (0, 2)
+                for socket in range(2)
+            ]
+            writer.append(records, tenants=[100] if t < 20 else [100, 200])
+    # * Reopening carries on after the last indexed block, dropping rows written
+    # * after it and a torn index line (whatever the formatting of the others).
+    last = {"time": 39.5, "socket": 0, "joules": 39.5}
+    if fmt == "csv":
+        with open(os.path.join(directory, "30.csv"), "a") as f:
+            f.write("39.5,0,39.5\n")
+    else:
+        with TraceWriter(os.path.join(directory, "30.etr")) as trace:
+            trace.append([last])
+    index_path = os.path.join(directory, "index.ndjson")
+    with open(index_path, "rb+") as f:
+        lines = [json.loads(line) for line in f]
+        f.seek(0)
+        f.truncate()
+        for line in lines:
+            f.write(json.dumps(line, separators=(",", ":")).encode() + b"\n")
+        f.write(b'{"segment": "30')
+    with SegmentWriter(directory, 10, fmt) as writer:
+        writer.append(
+            [{"time": 39.0, "socket": 0, "joules": 39.0}] * 2
+            + [{"time": 40.0, "socket": 0, "joules": 40.0}],
+            [200],
+        )
+    with open(os.path.join(directory, "index.ndjson"), "ab") as f:
+        f.write(b'{"segment": "40')
+
+    blocks = load_index(directory)
+    assert sorted({block["segment"] for block in blocks}) == [
+        f"{start}.{'csv' if fmt == 'csv' else 'etr'}" for start in (0, 10, 20, 30, 40)
+    ]
+    assert sum(block["rows"] for block in blocks) == 43
+    assert 39.5 not in query(directory)["time"].tolist()
+    segment = os.path.join(directory, "30." + ("csv" if fmt == "csv" else "etr"))
+    assert load_traces(segment)["time"].max() == 39.0
+
+    df = query(directory, 12, 17)
+    assert df["time"].tolist() == [12.0, 12.0, 14.0, 14.0, 16.0, 16.0]
+    assert np.allclose(df["joules"], df["time"] + df["socket"])
+    assert query(directory, tenant=200)["time"].min() == 20.0
+    assert query(directory, 0, 15, tenant=200).empty
+    assert query(directory, columns=["socket"]).shape == (43, 1)
+    assert len(load_traces(directory)) == 43
@@ -0,0 +1,90 @@
+import json
+import socket
+import threading
+import time
+
+import numpy as np
+
+from energat.sinks import Sink, SinkPipeline, parse_sink
+from energat.traceio import load_traces
+
+
+class ListSink(Sink):
+    def __init__(self, name: str, batch_size: int):
+        self.name = name
+        self.batch_size = batch_size
+        self.batches = []
+
+    def write(self, batch):
+        self.batches.append(batch)
+
+
+class SlowSink(Sink):
+    def __init__(self, gate: threading.Event):
+        self.gate = gate
+        self.batches = []
+
+    def write(self, batch):
+        self.gate.wait()
+        self.batches.append(batch)
+
+
+def test_sinks(tmp_path):
+    base = str(tmp_path / "traces")
+    server = socket.create_server(("127.0.0.1", 0))
+    received = []
+
+    def serve():
+        conn, _ = server.accept()
+        with conn, conn.makefile("rb") as f:
+            received.extend(json.loads(line) for line in f)
+
+    thread = threading.Thread(target=serve)
+    thread.start()
+
+    gate = threading.Event()
+    slow = SlowSink(gate)
+    specs = ["csv", "binary", "ndjson", "tcp:127.0.0.1:%d" % server.getsockname()[1]]
+    pipeline = SinkPipeline([parse_sink(spec, base) for spec in specs] + [slow])
+    for t in range(3):
+        records = [
+            {"time": float(t), "socket": socket_id, "joules": np.float64(t + socket_id)}
+            for socket_id in range(2)
+        ]
+        pipeline.submit(records, tenants={100})
+    # * The other sinks are not held up by a slow one.
+    while pipeline.metrics()["ndjson"]["written"] < 3:
+        time.sleep(0.01)
+    assert not slow.batches
+    gate.set()
+    pipeline.close()
+    thread.join()
+    server.close()
+
+    for path in (base + ".csv", base + ".etr"):
+        assert load_traces(path)["joules"].tolist() == [0, 1, 1, 2, 2, 3]
+    with open(base + ".ndjson") as f:
+        assert [json.loads(line) for line in f] == received
+    assert [record["joules"] for record in received] == [0, 1, 1, 2, 2, 3]
+    # * All sinks got the same (immutable) batches.
+    assert all(batch.tenants == {100} for batch in slow.batches)
+    assert isinstance(slow.batches[0].records, tuple)
+
+
+def test_sink_batching():
+    archive, live, other = (
+        ListSink("archive", 4),
+        ListSink("live", 1),
+        ListSink("other", 4),
+    )
+    pipeline = SinkPipeline([archive, live, other])
+    for t in range(5):
+        pipeline.submit([{"time": float(t)}, {"time": float(t)}], tenants={t})
+    pipeline.close()
+
+    # * Live sinks get every submission, without the archives writing as often.
+    assert [len(batch.records) for batch in live.batches] == [2] * 5
+    assert [len(batch.records) for batch in archive.batches] == [4, 4, 2]
+    assert archive.batches[0].tenants == {0, 1}
+    # * Sinks with the same batch size share the same batches.
+    assert all(a is b for a, b in zip(archive.batches, other.batches))
@@ -0,0 +1,31 @@
+import numpy as np
+
+from energat.sketch import SpaceSaving, top_k
+
+
+def test_top_k():
+    weights = np.array([0.0, 3.0, 1.0, 5.0, 3.0])
+    assert top_k(np.arange(5), weights, 2).tolist() == [3, 1]
+    assert top_k(np.arange(5), weights, 10).tolist() == [3, 1, 4, 2]
+    assert top_k(np.arange(5), weights, 0).size == 0
+
+
+def test_space_saving():
+    rng = np.random.default_rng(0)
+    sketch = SpaceSaving(capacity=8)
+    totals = {}
+    for _ in range(50):
+        # * Two heavy hitters among many light keys.
+        keys = np.concatenate([[1, 2], rng.integers(10, 1000, size=20)])
+        weights = np.concatenate([[5.0, 3.0], rng.random(20)])
+        sketch.update(keys, weights, [f"task-{key}" for key in keys])
+        for key, weight in zip(keys.tolist(), weights.tolist()):
+            totals[key] = totals.get(key, 0.0) + weight
+
+    assert len(sketch) == 8
+    assert np.isclose(sketch.total, sum(totals.values()))
+    top = sketch.top(2)
+    assert [(key, label) for key, label, *_ in top] == [(1, "task-1"), (2, "task-2")]
+    for key, label, count, error in sketch.top(8):
+        # * Counts bound the true totals from above, counts - errors from below.
+        assert count - error <= totals[key] + 1e-9 <= count + 2e-9
@@ -0,0 +1,72 @@
+import numpy as np
+
+from energat.kernel import credit_fracs, power_law_energy
+from energat.snapshot import Snapshot
+
+
+class FakeClock(object):
+    def __init__(self):
+        self.now = 0.0
+
+    def __call__(self):
+        return self.now
+
+    def advance(self, sec):
+        self.now += sec
+        return sec
+
+    def read(self, sec, value):
+        self.now += sec
+        return value
+
+
+def test_snapshot():
+    clock = FakeClock()
+    before = Snapshot(clock)
+    before.capture("targets", clock.advance, 0.02)
+    before.capture("rapl", clock.advance, 0.001)
+
+    clock.now = 0.1
+    snapshot = Snapshot(clock)
+    assert snapshot.capture("targets", clock.advance, 0.04) == 0.04
+    snapshot.capture("rapl", clock.advance, 0.001)
+
+    assert abs(snapshot.span - 0.041) < 1e-9
+    # * Midpoints: targets at 0.01 -> 0.12, rapl at 0.0205 -> 0.1405.
+    assert abs(snapshot.misalignment(before, "rapl")["targets"] + 0.01) < 1e-9
+    assert abs(snapshot.window(before, "targets") - 0.11) < 1e-9
+    assert abs(snapshot.window(before, "rapl") - 0.12) < 1e-9
+
+
+def test_skew_correction():
+    # * The targets use 1 CPU and the host 2, but the cputime of the targets is
+    # * read over a shorter window than the host's and the energy.
+    clock = FakeClock()
+    before = Snapshot(clock)
+    before.capture("targets", clock.read, 0.02, 0.0)
+    before.capture("server", clock.read, 0.001, 0.0)
+    before.capture("rapl", clock.read, 0.001, 0.0)
+
+    clock.now = 0.1
+    snapshot = Snapshot(clock)
+    snapshot.capture("targets", clock.read, 0.04, 0.11)
+    snapshot.capture("server", clock.read, 0.001, 0.24)
+    snapshot.capture("rapl", clock.read, 0.001, 10.0)
+
+    # * Windows: targets 0.11s, server and rapl 0.12s.
+    misalignment = snapshot.misalignment(before, "rapl", ("targets", "server"))
+    assert abs(misalignment["targets"] + 0.01) < 1e-9
+    assert abs(misalignment["server"]) < 1e-9
+    assert "rapl" not in misalignment
+
+    def ascribe(scales):
+        fracs = credit_fracs(
+            [snapshot["targets"] * scales["targets"]],
+            [snapshot["server"] * scales["server"]],
+        )
+        return power_law_energy([snapshot["rapl"]], fracs, 1.0)[0]
+
+    uncorrected = ascribe(dict(targets=1.0, server=1.0))
+    corrected = ascribe(snapshot.scales(before, "rapl"))
+    assert abs(uncorrected - 10 * 0.11 / 0.24) < 1e-9
+    assert abs(corrected - 5.0) < 1e-9
@@ -0,0 +1,44 @@
+import numpy as np
+import pytest
+
+from energat import tasktrace
+from energat.tasktrace import TaskTraceBuffer, load_task_traces
+
+
+@pytest.mark.parametrize("stream,zstd", [(False, False), (True, False), (True, True)])
+def test_task_traces(tmp_path, monkeypatch, stream, zstd):
+    if zstd:
+        pytest.importorskip("zstandard")
+    else:
+        monkeypatch.setattr(tasktrace, "zstandard", None)
+    buffer = TaskTraceBuffer(str(tmp_path / "tasks"), stream)
+    for ts in range(3):
+        tasks = {
+            "time": np.full(2, float(ts)),
+            "tid": np.array([11, 12]),
+            "tgid": np.array([10, 10]),
+            "comm": np.array(["worker-1", "worker-2"]),
+            "socket": np.array([0, 1]),
+            "cpu_joules": np.array([1.0, 2.0]),
+            "dram_joules": np.array([0.5, 0.5]),
+        }
+        processes = {
+            "time": np.full(2, float(ts)),
+            "tgid": np.array([10, 10]),
+            "comm": np.array(["server-main-loop"] * 2),
+            "socket": np.array([0, 1]),
+            "num_threads": np.array([2, 2]),
+            "cpu_joules": np.array([1.0, 2.0]),
+            "dram_joules": np.array([0.5, 0.5]),
+        }
+        buffer.append(tasks, processes)
+        if ts != 1:
+            buffer.write(*buffer.take())
+
+    tasks, processes = load_task_traces(str(tmp_path / "tasks"))
+    assert len(tasks) == 6 and tasks.cpu_joules.sum() == 9.0
+    assert tasks.groupby("comm").size().to_dict() == {"worker-1": 3, "worker-2": 3}
+    assert processes.groupby("socket").cpu_joules.sum().tolist() == [3.0, 6.0]
+    assert tasks.tid.dtype == np.int64 and tasks.comm.iloc[-1] == "worker-2"
+    # * Longer command names are cut at TASK_COMM_LEN like the kernel does.
+    assert set(processes.comm) == {"server-main-loo"}
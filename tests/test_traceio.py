@@ -0,0 +1,57 @@
+import numpy as np
+import pytest
+
+from energat.traceio import TraceReader, TraceWriter, load_traces
+
+
+def test_trace_file(tmp_path):
+    path = str(tmp_path / "traces.etr")
+    for ts in range(3):
+        records = [
+            {"time": float(ts), "socket": socket, "joules": ts + socket / 2, "top": ""}
+            for socket in range(2)
+        ]
+        records[1]["top"] = f"{ts}/worker=1.000"
+        # * Every batch reopens the file, as the tracer does.
+        with TraceWriter(path) as writer:
+            writer.append(records)
+
+    with TraceReader(path) as reader:
+        assert reader.num_rows == 6 and len(reader.groups) == 3
+        assert reader.schema == {
+            "time": "<f8",
+            "socket": "<i8",
+            "joules": "<f8",
+            "top": "str",
+        }
+        # * Numeric columns of a row group are views of the mapping.
+        group = reader.group_column(2, "joules")
+        assert not group.flags.owndata and group.tolist() == [2.0, 2.5]
+        assert reader.column("top", [1]).tolist() == ["", "1/worker=1.000"]
+        del group
+
+    df = load_traces(path)
+    assert np.allclose(df["joules"], [0, 0.5, 1, 1.5, 2, 2.5])
+    assert df["socket"].tolist() == [0, 1] * 3
+
+    with TraceWriter(path) as writer, pytest.raises(ValueError):
+        writer.append([{"time": 3.0}])
+
+
+def test_trace_recovery(tmp_path):
+    path = str(tmp_path / "traces.etr")
+    writer = TraceWriter(path, fsync_bytes=1)
+    for ts in range(3):
+        writer.append([{"time": float(ts), "joules": 1.0}])
+    assert writer.unsynced_bytes == 0
+    # * Killed without closing, in the middle of the last frame.
+    writer.file.truncate(writer.end - 4)
+    writer.file.close()
+
+    with TraceReader(path) as reader:
+        assert reader.recovered and reader.num_rows == 2
+    with TraceWriter(path) as writer:
+        writer.append([{"time": 3.0, "joules": 1.0}])
+    with TraceReader(path) as reader:
+        assert not reader.recovered
+        assert reader.column("time").tolist() == [0.0, 1.0, 3.0]
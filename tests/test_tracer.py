@@ -1,3 +1,14 @@
+import functools
+import os
+import threading
+from types import SimpleNamespace
+
+import numpy as np
+
+import energat.perf as perf
+import energat.tracer as tracer_module
+from energat.common import FLAGS
+from energat.kernel import AttributionKernel
 from energat.tracer import EnergyTracer
 
 
@@ -13,3 +24,158 @@ def test_tracer():
     assert len(numa_mem) == num_sockets
     # * Currently only supports two domains.
     assert max_ranges.size == num_sockets * 2
+
+
+class FakeKernel(object):
+    def cputime_per_socket(self):
+        return np.array([0.3, 0.1]), np.zeros(2)
+
+    def memory_per_socket(self):
+        return np.full(2, 0.2), np.zeros(2), np.zeros(2)
+
+
+def fake_tracer():
+    """Tracer state used to ascribe energy on two sockets (no hardware)."""
+    tracer = SimpleNamespace(
+        num_cpu_sockets=2,
+        targets_status={1: True},
+        kernel=FakeKernel(),
+        core_pkg_map={0: 0, 1: 1},
+        imc_counters=None,
+        thread_counters=None,
+        tracer_process=SimpleNamespace(pid=0),
+    )
+    tracer.compute_cycle_credit_fracs = functools.partial(
+        EnergyTracer.compute_cycle_credit_fracs, tracer
+    )
+    return tracer
+
+
+def test_cycle_credit():
+    tracer = fake_tracer()
+    # * Cycles are split 3:1 like the cputime, over the host's cycles per socket.
+    fracs = EnergyTracer.compute_cycle_credit_fracs(
+        tracer, np.array([0.3, 0.1]), 4e9, np.array([6e9, 4e9])
+    )
+    assert np.allclose(fracs, [0.5, 0.25])
+    # * Evenly split without cputime, and nothing for sockets without cycles.
+    fracs = EnergyTracer.compute_cycle_credit_fracs(
+        tracer, np.zeros(2), 2e9, np.array([4e9, 0.0])
+    )
+    assert np.allclose(fracs, [0.25, 0.0])
+
+    energy = np.array([[10.0, 10.0], [5.0, 5.0]])
+    ascribed, credits, _ = EnergyTracer.ascribe_energy(
+        tracer, energy, np.ones(2), cycle_counts=(4e9, np.array([6e9, 4e9]))
+    )
+    assert np.allclose(credits[0], [0.5, 0.25])
+    assert np.allclose(ascribed[0], 10 * np.array([0.5, 0.25]) ** FLAGS.gamma)
+
+
+def test_cycle_credit_fallback(monkeypatch):
+    def unsupported(*args):
+        raise OSError("perf_event_open")
+
+    monkeypatch.setattr(FLAGS, "cpu_credit", "cycles")
+    monkeypatch.setattr(tracer_module, "ThreadCounters", unsupported)
+    tracer = fake_tracer()
+    # * Without counters, the package credit is the cputime share.
+    tracer.thread_counters = EnergyTracer.open_thread_counters(tracer)
+    assert tracer.thread_counters is None
+    cycle_counts, mem_traffic = EnergyTracer.read_counter_activity(tracer)
+    assert cycle_counts is None and mem_traffic is None
+
+    energy = np.array([[10.0, 10.0], [5.0, 5.0]])
+    _, credits, _ = EnergyTracer.ascribe_energy(
+        tracer, energy, np.array([1.0, 0.5]), cycle_counts=cycle_counts
+    )
+    assert np.allclose(credits[0], [0.3, 0.2])
+
+
+def test_kernel_work_credit():
+    tracer = fake_tracer()
+    energy = np.array([[10.0, 10.0], [5.0, 5.0]])
+    server_cputime, kernel_cputime = np.array([1.0, 0.5]), np.array([0.1, 0.05])
+    # * Kernel work is credited by its cputime share in every CPU credit mode.
+    modes = {
+        "cputime": ({}, [0.4, 0.3]),
+        "cgroup": ({"cpu_credit_fracs": np.full(2, 0.2)}, [0.3, 0.3]),
+        "cycles": ({"cycle_counts": (4e9, np.array([6e9, 4e9]))}, [0.6, 0.35]),
+    }
+    for mode, (counters, cpu_fracs) in modes.items():
+        _, credits, _ = EnergyTracer.ascribe_energy(
+            tracer,
+            energy,
+            server_cputime,
+            kernel_cputime_sec=kernel_cputime,
+            **counters,
+        )
+        assert np.allclose(credits[0], cpu_fracs), mode
+
+
+def test_target_gone_while_read(monkeypatch):
+    # * 12 exits after being listed, so its stat can't be read anymore.
+    cputimes = {11: (2.0, 1), 12: (0, -1)}
+    monkeypatch.setattr(tracer_module, "read_cputime_and_cpu", cputimes.get)
+    tracer = fake_tracer()
+    tracer.kernel = AttributionKernel(num_sockets=2)
+    tracer.placement = None
+    tracer.target_processes, tracer.target_threads = {11, 12}, set()
+    tracer.targets_status = {
+        tid: SimpleNamespace(slot=tracer.kernel.add(tid, tid, cputime=1.0))
+        for tid in (11, 12)
+    }
+    tracer.remove_target = functools.partial(EnergyTracer.remove_target, tracer)
+
+    read = EnergyTracer.read_targets_cputime(tracer)
+    assert read[0].tolist() == [0] and read[1:] == ([2.0], [1], [12])
+    EnergyTracer.record_targets_cputime(tracer, *read)
+    assert list(tracer.targets_status) == [11] and len(tracer.kernel) == 1
+    assert tracer.kernel.cputime_delta[0] == 1.0
+
+
+def test_thread_counters_follow_targets(monkeypatch):
+    # * Fake groups counting 1 of each event per read of the group.
+    counts = {}
+
+    def open_group(events, pid, cpu, attr_flags=0):
+        fds = [os.open(os.devnull, os.O_RDONLY) for _ in events]
+        counts[fds[0]] = np.zeros(len(events))
+        return fds
+
+    def read_group(fd, num_events):
+        counts[fd] += 1
+        return counts[fd].copy()
+
+    monkeypatch.setattr(perf, "open_group", open_group)
+    monkeypatch.setattr(perf, "read_group", read_group)
+    monkeypatch.setattr(perf, "SystemCycles", lambda core_pkg_map: None)
+    tracer = fake_tracer()
+    tracer.kernel = AttributionKernel(num_sockets=2)
+    tracer.placement = None
+    tracer.targets_status, tracer.target_tgids = {}, {}
+    tracer.target_processes, tracer.target_threads = set(), set()
+    tracer.thread_counters = perf.ThreadCounters(tracer.core_pkg_map)
+    tracer.remove_target = functools.partial(EnergyTracer.remove_target, tracer)
+
+    # * A child thread started after tracing is attached once found.
+    stop = threading.Event()
+    child = threading.Thread(target=stop.wait)
+    child.start()
+    try:
+        tracer.target_threads.add(child.native_id)
+        EnergyTracer.sync_targets_status(tracer)
+        assert list(tracer.thread_counters.group_fds) == [child.native_id]
+        deltas = tracer.thread_counters.read_deltas()
+        assert deltas[child.native_id].tolist() == [1.0] * 4
+    finally:
+        stop.set()
+        child.join()
+
+    # * Once departed, its group is closed and its last counts still reported.
+    tracer.target_threads.clear()
+    EnergyTracer.sync_targets_status(tracer)
+    assert not tracer.thread_counters.group_fds and not tracer.targets_status
+    deltas = tracer.thread_counters.read_deltas()
+    assert deltas[child.native_id].tolist() == [1.0] * 4
+    assert not tracer.thread_counters.read_deltas()
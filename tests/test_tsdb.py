@@ -0,0 +1,45 @@
+import numpy as np
+
+from energat.tsdb import (
+    TimeSeriesStore,
+    decode_dod,
+    decode_xor,
+    encode_dod,
+    encode_xor,
+)
+
+
+def test_codecs():
+    rng = np.random.default_rng(0)
+    floats = np.concatenate([[0.0, 0.0, -1.5, np.inf], rng.normal(size=500)])
+    assert np.array_equal(decode_xor(encode_xor(floats), floats.size), floats)
+    ints = np.concatenate(
+        [[-(2**62), 2**62, 0, 0], np.cumsum(rng.integers(-(2**40), 2**40, size=500))]
+    )
+    assert np.array_equal(decode_dod(encode_dod(ints), ints.size), ints)
+
+
+def test_time_series_store():
+    rng = np.random.default_rng(0)
+    store = TimeSeriesStore(retention_sec=60, block_size=256)
+    # * 10 ms samples of an energy counter (uJ) and of power readings.
+    times = 1000 + np.arange(10000) * 0.01 + rng.normal(scale=1e-4, size=10000)
+    counter = np.cumsum(rng.integers(400_000, 500_000, size=10000))
+    for t, uj in zip(times, counter):
+        store.append("socket0/pkg_uj", int(uj), t, counter=True)
+        store.append("socket0/watts", round(uj / 1e4, 1), t)
+    # * A series that stopped long ago.
+    store.append("tenant42/cpu_joules", 1.0, 900.0)
+
+    ts, values = store.query("socket0/pkg_uj", 1050, 1050.5)
+    assert np.allclose(ts, np.round(times[5000:5051], 3))
+    assert np.array_equal(values, counter[5000:5051])
+    # * Blocks older than a minute have been dropped as new ones were sealed.
+    ts, values = store.query("socket0/watts")
+    assert 6000 <= values.size < 10000 and ts[0] >= times[-1] - 60 - 256 * 0.01
+    assert np.allclose(values, np.round(counter[-values.size :] / 1e4, 1))
+    # * Timestamps and counter in about 3 bytes per sample (plus the head block).
+    assert store.series["socket0/pkg_uj"].nbytes < values.size * 3.5 + 16 * 256
+
+    store.evict(times[-1])
+    assert store.keys() == ["socket0/pkg_uj", "socket0/watts"]
@@ -0,0 +1,34 @@
+import threading
+
+from energat.writer import AsyncWriter
+
+
+def test_async_writer(tmp_path):
+    for policy, expected in (
+        ("drop_oldest", [0, 3, 4]),
+        ("spill", [0, 1, 2, 3, 4]),
+    ):
+        gate = threading.Event()
+        written = []
+
+        def write(batch):
+            gate.wait()
+            written.append(batch)
+
+        writer = AsyncWriter(
+            {"traces": write}, policy, max_pending=2, spill_dir=str(tmp_path)
+        )
+        writer.submit("traces", 0)
+        # * Wait for the thread to hold the first batch.
+        while writer.depth:
+            pass
+        for batch in range(1, 5):
+            writer.submit("traces", batch)
+        metrics = writer.metrics()
+        assert metrics["max_depth"] == (2 if policy == "drop_oldest" else 4)
+        gate.set()
+        writer.close()
+        assert written == expected
+        metrics = writer.metrics()
+        assert metrics["written"] == len(expected) and metrics["depth"] == 0
+        assert metrics["dropped" if policy == "drop_oldest" else "spilled"] == 2